@@ -1,22 +1,161 @@
 #pragma once
 
 #include "graph.h"
+#include "landmarks.h"
+#include "search_queue.h"
 #include <vector>
+#include <cstdint>
+#include <limits>
+#include <functional>
 
 
+// Query algorithm used by RoutingEngine::route
+enum struct SearchMode {
+    AStar,          // unidirectional A*
+    ALT,            // A* with landmark lower bounds (falls back to A* when unavailable)
+    Bidirectional,  // bidirectional Dijkstra over forward and incoming edges
+    Dijkstra,       // plain Dijkstra, the reference for validating the others
+    CH,             // contraction hierarchy (falls back to A* when unavailable)
+    CCH,            // customizable contraction hierarchy (falls back like CH)
+};
+
+// Priority queue behind the AStar searches (see search_queue.h)
+enum struct QueueKind {
+    Binary,       // binary heap with lazy deletion
+    Quaternary,   // indexed 4-ary heap with decrease-key (default)
+    Radix,        // monotone radix heap
+};
+
 struct AStarResult {
     std::vector<int> path;
     double total_cost;
 };
 
 
+// Scratch state for one graph search, meant to be reused across queries.
+//
+// The per-node arrays are sized to the graph once. Entries carry the
+// generation that last wrote them, so reset() just bumps the generation and
+// a query only pays for the nodes it actually touches.
+class SearchContext {
+public:
+    // Start a new search over a graph with num_nodes nodes
+    void reset(int num_nodes);
+
+    bool reached(int v) const { return stamp_[v] == generation_; }
+    bool closed(int v) const { return closed_[v] == generation_; }
+    double g(int v) const {
+        return reached(v) ? g_[v] : std::numeric_limits<double>::infinity();
+    }
+    int parent(int v) const { return reached(v) ? parent_[v] : -1; }
+
+    void reach(int v, double g, int parent) {
+        stamp_[v] = generation_;
+        g_[v] = g;
+        parent_[v] = parent;
+    }
+    void close(int v) { closed_[v] = generation_; }
+    void reopen(int v) { closed_[v] = 0; }
+
+    // Queue policy of the AStar searches run on this context; each search
+    // resets the policy's queue it uses. The hierarchy queries always take
+    // open<BinaryHeap>().
+    QueueKind queue_kind() const { return queue_kind_; }
+    void set_queue_kind(QueueKind kind) { queue_kind_ = kind; }
+    template <typename Queue> Queue& open();
+
+    // Thread-local contexts for callers that do not manage their own;
+    // bidirectional searches use slots 0 and 1
+    static SearchContext& local(int slot = 0);
+
+private:
+    uint32_t generation_ = 0;
+    std::vector<uint32_t> stamp_;
+    std::vector<uint32_t> closed_;
+    std::vector<double> g_;
+    std::vector<int> parent_;
+
+    QueueKind queue_kind_ = QueueKind::Quaternary;
+    BinaryHeap binary_;
+    QuaternaryHeap quaternary_;
+    RadixHeap radix_;
+};
+
+template <> inline BinaryHeap& SearchContext::open<BinaryHeap>() { return binary_; }
+template <> inline QuaternaryHeap& SearchContext::open<QuaternaryHeap>() { return quaternary_; }
+template <> inline RadixHeap& SearchContext::open<RadixHeap>() { return radix_; }
+
+
+// Entry points for the graph searches; each one is an instantiation of
+// SearchKernel (search_kernel.h) run with the context's queue policy. Each
+// pins the graph's current weights unless given a snapshot to search.
 class AStar {
 public:
     // Compute shortest path from start to goal (graph indices)
     // Returns a vector of graph node indices representing the path
     static AStarResult shortest_path(const Graph& graph, int start_idx, int goal_idx);
+    static AStarResult shortest_path(const Graph& graph, int start_idx, int goal_idx,
+                                     SearchContext& ctx);
+    static AStarResult shortest_path(const Graph& graph, int start_idx, int goal_idx,
+                                     const EdgeWeights::Snapshot& weights, SearchContext& ctx);
 
-private:
-    // Heuristic: haversine distance between two nodes
-    static double heuristic(const Node& a, const Node& b);
+    // A* guided by landmark lower bounds (ALT)
+    static AStarResult alt(const Graph& graph, const Landmarks& landmarks,
+                           int start_idx, int goal_idx);
+    static AStarResult alt(const Graph& graph, const Landmarks& landmarks,
+                           int start_idx, int goal_idx, SearchContext& ctx);
+
+    // A* that gives up as soon as every open path is known to cost more than
+    // max_cost, returning infinity. Uses landmark bounds when given, else the
+    // geometric heuristic.
+    static AStarResult bounded(const Graph& graph, int start_idx, int goal_idx,
+                               double max_cost, const Landmarks* landmarks = nullptr);
+    static AStarResult bounded(const Graph& graph, int start_idx, int goal_idx,
+                               double max_cost, const Landmarks* landmarks,
+                               SearchContext& ctx);
+    static AStarResult bounded(const Graph& graph, int start_idx, int goal_idx,
+                               double max_cost, const Landmarks* landmarks,
+                               const EdgeWeights::Snapshot& weights, SearchContext& ctx);
+
+    // Unidirectional Dijkstra (A* without a heuristic)
+    static AStarResult dijkstra(const Graph& graph, int start_idx, int goal_idx);
+    static AStarResult dijkstra(const Graph& graph, int start_idx, int goal_idx,
+                                SearchContext& ctx);
+    static AStarResult dijkstra(const Graph& graph, int start_idx, int goal_idx,
+                                const EdgeWeights::Snapshot& weights, SearchContext& ctx);
+
+    // Dijkstra from one start to several goals, stopping once every goal is
+    // settled. Writes goals.size() costs to out, infinity when unreachable.
+    static void one_to_many(const Graph& graph, int start_idx,
+                            const std::vector<int>& goals, double* out);
+    static void one_to_many(const Graph& graph, int start_idx,
+                            const std::vector<int>& goals, double* out,
+                            SearchContext& ctx);
+
+    // Dijkstra backwards from the goal over incoming edges: nodes are settled
+    // in order of their cost to reach the goal and passed to visit(node, cost)
+    // until it returns false or the graph is exhausted
+    static void reverse_dijkstra(const Graph& graph, int goal_idx,
+                                 const std::function<bool(int, double)>& visit);
+    static void reverse_dijkstra(const Graph& graph, int goal_idx,
+                                 const std::function<bool(int, double)>& visit,
+                                 SearchContext& ctx);
+
+    // The same scan forwards from the start over outgoing edges, settling
+    // nodes in order of their cost from the start
+    static void forward_dijkstra(const Graph& graph, int start_idx,
+                                 const std::function<bool(int, double)>& visit);
+    static void forward_dijkstra(const Graph& graph, int start_idx,
+                                 const std::function<bool(int, double)>& visit,
+                                 SearchContext& ctx);
+
+    // Bidirectional Dijkstra: grows a forward search from the start and a
+    // backward search over incoming edges from the goal, and stops once the
+    // two queue minima together can no longer improve the best meeting point
+    static AStarResult bidirectional(const Graph& graph, int start_idx, int goal_idx);
+    static AStarResult bidirectional(const Graph& graph, int start_idx, int goal_idx,
+                                     SearchContext& forward, SearchContext& backward);
+    static AStarResult bidirectional(const Graph& graph, int start_idx, int goal_idx,
+                                     const EdgeWeights::Snapshot& weights,
+                                     SearchContext& forward, SearchContext& backward);
 };
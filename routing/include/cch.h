@@ -0,0 +1,98 @@
+#pragma once
+
+#include "graph.h"
+#include "astar.h"
+#include <vector>
+#include <cstdint>
+
+
+// Customizable Contraction Hierarchy over a frozen Graph.
+//
+// Preprocessing is split in two. The metric-independent part runs once: a
+// nested-dissection node order from recursive geometric bisection, and the
+// chordal upward graph that contracting in that order produces (every fill
+// arc is kept, no witness searches). Customization then derives arc weights
+// from the current edge weights by relaxing lower triangles, bottom-up and in
+// parallel across the levels of the elimination tree. After weight changes
+// only the arcs whose triangles contain a changed arc are recomputed.
+//
+// Nodes are renumbered by rank internally; the public interface uses graph
+// node indices and edge slots.
+class CustomizableCH {
+public:
+    CustomizableCH() = default;
+
+    // Order and contract the graph, then run a full customization
+    explicit CustomizableCH(const Graph& graph, int num_threads = 0);
+
+    bool empty() const { return rank_.empty(); }
+    int num_arcs() const { return static_cast<int>(arc_head_.size()); }
+
+    // Recompute arc weights from the graph's current weights after the given
+    // edge slots changed. Returns the number of arcs recomputed.
+    int customize(const Graph& graph, const std::vector<int>& changed_slots);
+
+    // Exact shortest path in original graph nodes, using the current metric
+    AStarResult shortest_path(int start_idx, int goal_idx) const;
+    AStarResult shortest_path(int start_idx, int goal_idx,
+                              SearchContext& forward, SearchContext& backward) const;
+
+    // Costs from every source to every target node, row-major into out
+    // (sources.size() * targets.size() entries, infinity when unreachable).
+    // Each target's upward search fills buckets along its elimination-tree
+    // path; each source's upward search then scans the buckets it passes.
+    void many_to_many(const std::vector<int>& sources, const std::vector<int>& targets,
+                      double* out) const;
+
+private:
+    int num_threads_ = 1;
+
+    std::vector<int> rank_;          // graph node -> rank
+    std::vector<int> node_;          // rank -> graph node
+    std::vector<int> etree_parent_;  // lowest upper neighbour, -1 for roots
+    std::vector<int> level_;         // elimination-tree height, by rank
+
+    // Upward arcs x -> arc_head_ (higher rank), grouped by lower endpoint x
+    std::vector<int> up_offsets_;
+    std::vector<int> arc_head_;
+    std::vector<int> arc_tail_;
+
+    // Lower neighbours of each node, sorted, with the connecting arc id
+    std::vector<int> down_offsets_;
+    std::vector<int> down_tail_;
+    std::vector<int> down_arc_;
+
+    // Metric: travel cost lower -> higher (up) and higher -> lower (down),
+    // plus the cost of the original edges alone (infinity if none)
+    std::vector<double> up_weight_;
+    std::vector<double> down_weight_;
+    std::vector<double> up_base_;
+    std::vector<double> down_base_;
+
+    // Edge slot -> arc id, negated and offset by one for downward travel
+    std::vector<int> slot_arc_;
+
+    // Arcs grouped by the level of their lower endpoint
+    std::vector<int> level_offsets_;
+    std::vector<int> level_arcs_;
+
+    void compute_order(const Graph& graph);
+    void build_upward_graph(const Graph& graph);
+    void set_base_weights(const Graph& graph, const EdgeWeights::Snapshot& weights, int slot);
+
+    // Relax the lower triangles of one arc; true if its weights changed
+    bool customize_arc(int arc);
+
+    // Arc id between two ranks (either order), -1 if none
+    int find_arc(int a, int b) const;
+
+    // Relax every elimination-tree ancestor of rank r, up or down arcs
+    void upward_walk(int r, bool backward, SearchContext& ctx) const;
+
+    // Append the graph nodes of travel from rank a to rank b, excluding a
+    void unpack(int a, int b, std::vector<int>& path) const;
+
+    // Run fn(i) for i in [0, n), split across threads when n is large
+    template <typename F>
+    void parallel_for(int n, F&& fn) const;
+};
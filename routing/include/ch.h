@@ -0,0 +1,60 @@
+#pragma once
+
+#include "graph.h"
+#include "astar.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Contraction Hierarchy over a frozen Graph.
+//
+// Nodes are contracted one at a time in order of edge difference; whenever
+// removing a node would break a shortest path between two of its remaining
+// neighbours, a shortcut arc (remembering the contracted middle node) is
+// added. Queries then only ever move to higher-ranked nodes: a forward search
+// from the start and a backward search from the goal meet at the top of the
+// path, and shortcuts are unpacked back into original graph nodes.
+class ContractionHierarchy {
+public:
+    ContractionHierarchy() = default;
+
+    // Contract every node of the graph (its current weights)
+    explicit ContractionHierarchy(const Graph& graph);
+
+    bool empty() const { return rank_.empty(); }
+    int num_nodes() const { return static_cast<int>(rank_.size()); }
+    int num_shortcuts() const { return num_shortcuts_; }
+
+    // Exact shortest path in original graph nodes
+    AStarResult shortest_path(int start_idx, int goal_idx) const;
+    AStarResult shortest_path(int start_idx, int goal_idx,
+                              SearchContext& forward, SearchContext& backward) const;
+
+    // Binary snapshot, tagged with the fingerprint of the graph it was built from
+    bool save(const std::string& path, uint64_t graph_fingerprint) const;
+    bool load(const std::string& path, uint64_t graph_fingerprint);
+
+private:
+    std::vector<int> rank_;
+    int num_shortcuts_ = 0;
+
+    // Upward arcs u -> v (rank v > rank u), relaxed by the forward search
+    std::vector<int> up_offsets_;
+    std::vector<int> up_to_;
+    std::vector<double> up_weight_;
+    std::vector<int> up_middle_;     // contracted middle node, -1 for an original edge
+
+    // Arcs v -> u into u from higher-ranked v, stored at u with to = v and
+    // relaxed by the backward search
+    std::vector<int> down_offsets_;
+    std::vector<int> down_to_;
+    std::vector<double> down_weight_;
+    std::vector<int> down_middle_;
+
+    // Append the original-graph nodes of arc from -> to, excluding `from`
+    void unpack(int from, int to, std::vector<int>& path) const;
+
+    // Cheapest arc from -> to and its middle node; false if there is none
+    bool find_arc(int from, int to, double& weight, int& middle) const;
+};
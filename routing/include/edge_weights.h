@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+// Versioned per-slot edge weights that readers can use while a writer
+// updates them.
+//
+// Every version is immutable. Weights are split into fixed-size pages and a
+// version is a table of page pointers, so publishing an update copies the
+// page table plus the pages it touches and shares the rest with the previous
+// version. Readers pin the current version without locking: they announce
+// the epoch they entered in a reader slot, and a retired version is freed
+// only once no announced epoch predates its retirement. Writers are
+// serialized among themselves.
+//
+// Built with ROUTING_COMPACT, weights are stored as uint32 deciseconds
+// instead of double seconds, halving the bytes a relaxation reads. Every
+// accessor still takes and returns seconds; round() gives the value a
+// weight reads back as.
+//
+// Each version also carries an upper bound on edge speed, kept exact as
+// weights move in both directions: every page remembers its fastest slot,
+// and a page is rescanned only when that slot gets slower.
+class EdgeWeights {
+    struct Version;
+    struct State;
+
+public:
+    static constexpr int PAGE_BITS = 10;
+    static constexpr int PAGE_SIZE = 1 << PAGE_BITS;
+
+#ifdef ROUTING_COMPACT
+    using Stored = uint32_t;
+
+    // Positive weights keep at least one tick, so no edge becomes free and
+    // the speed bound stays finite; the largest value stands for infinity
+    static Stored encode(double weight) {
+        constexpr Stored INF = std::numeric_limits<Stored>::max();
+        if (!(weight > 0.0)) return 0;
+        if (weight == std::numeric_limits<double>::infinity()) return INF;
+        double ticks = std::round(weight * 10.0);
+        if (ticks >= INF - 1.0) return INF - 1;
+        return ticks < 1.0 ? 1 : static_cast<Stored>(ticks);
+    }
+    static double decode(Stored ticks) {
+        if (ticks == std::numeric_limits<Stored>::max()) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return ticks * 0.1;
+    }
+#else
+    using Stored = double;
+
+    static Stored encode(double weight) { return weight; }
+    static double decode(Stored weight) { return weight; }
+#endif
+
+    static double round(double weight) { return decode(encode(weight)); }
+
+    // Speed of a slot at a given weight, in distance per unit of weight
+    using SpeedOf = std::function<double(int, double)>;
+
+    // A pinned version; weights read through it never change. Keep pins
+    // short-lived: versions retired while one is held stay allocated.
+    class Snapshot {
+    public:
+        Snapshot() = default;
+        Snapshot(Snapshot&& other) noexcept { *this = std::move(other); }
+        Snapshot& operator=(Snapshot&& other) noexcept;
+        ~Snapshot() { release(); }
+
+        double operator[](int slot) const {
+            return decode(pages_[slot >> PAGE_BITS][slot & (PAGE_SIZE - 1)]);
+        }
+        uint64_t version() const;
+        double max_speed() const;
+
+    private:
+        friend class EdgeWeights;
+        State* state_ = nullptr;
+        int reader_ = -1;
+        const Version* version_ = nullptr;
+        const Stored* const* pages_ = nullptr;
+
+        void release();
+    };
+
+    EdgeWeights();
+    EdgeWeights(const EdgeWeights& other);
+    EdgeWeights& operator=(const EdgeWeights& other);
+    EdgeWeights(EdgeWeights&& other) noexcept;
+    EdgeWeights& operator=(EdgeWeights&& other) noexcept;
+    ~EdgeWeights();
+
+    Snapshot pin() const;
+
+    // One weight from the current version
+    double get(int slot) const { return pin()[slot]; }
+    size_t size() const;
+    uint64_t version() const;
+
+    // Copy of the current weights, in slot order
+    std::vector<double> values() const;
+
+    // Replace every weight; speed_of gives the speed bound of each
+    void assign(const std::vector<double>& weights, const SpeedOf& speed_of);
+
+    // Publish one new version with the given (slot, weight) changes applied
+    // together; readers see all of them or none. The speed bound follows the
+    // new weights through speed_of. Returns the version number.
+    uint64_t publish(const std::vector<std::pair<int, double>>& updates,
+                     const SpeedOf& speed_of);
+
+private:
+    std::unique_ptr<State> state_;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+constexpr double EARTH_RADIUS_M = 6371000.0;
+constexpr double DEG_TO_RAD = M_PI / 180.0;
+
+// Great-circle distance in meters
+inline double haversine(double lat1, double lon1,
+                        double lat2, double lon2) {
+    double dlat = (lat2 - lat1) * DEG_TO_RAD;
+    double dlon = (lon2 - lon1) * DEG_TO_RAD;
+
+    double a = std::sin(dlat/2)*std::sin(dlat/2) +
+               std::cos(lat1*DEG_TO_RAD) *
+               std::cos(lat2*DEG_TO_RAD) *
+               std::sin(dlon/2)*std::sin(dlon/2);
+
+    return 2 * EARTH_RADIUS_M * std::asin(std::sqrt(a));
+}
+
+// Equirectangular projection to local meters around a reference point.
+// Accurate to well under a percent across a metro area, which is all the
+// spatial indexes need for pruning and ranking.
+struct LocalProjection {
+    double lat0 = 0.0;
+    double lon0 = 0.0;
+    double kx = EARTH_RADIUS_M * DEG_TO_RAD;
+    double ky = EARTH_RADIUS_M * DEG_TO_RAD;
+
+    LocalProjection() = default;
+    LocalProjection(double ref_lat, double ref_lon)
+        : lat0(ref_lat), lon0(ref_lon),
+          kx(EARTH_RADIUS_M * DEG_TO_RAD * std::cos(ref_lat * DEG_TO_RAD)),
+          ky(EARTH_RADIUS_M * DEG_TO_RAD) {}
+
+    double x(double lon) const { return (lon - lon0) * kx; }
+    double y(double lat) const { return (lat - lat0) * ky; }
+    double lon(double x) const { return lon0 + x / kx; }
+    double lat(double y) const { return lat0 + y / ky; }
+};
+
+// Encoded polyline (Google's format, 1e-5 degree precision) of n points.
+// Writes at most capacity - 1 characters plus a terminating NUL and returns
+// the full encoded length, so a short buffer can be retried at that size.
+inline size_t encode_polyline(const double* lats, const double* lons, size_t n,
+                              char* out, size_t capacity) {
+    size_t length = 0;
+    auto put = [&](char c) {
+        if (length + 1 < capacity) out[length] = c;
+        ++length;
+    };
+    auto put_value = [&](long long value) {
+        unsigned long long v = value < 0 ? ~(static_cast<unsigned long long>(value) << 1)
+                                         : static_cast<unsigned long long>(value) << 1;
+        while (v >= 0x20) {
+            put(static_cast<char>((0x20 | (v & 0x1f)) + 63));
+            v >>= 5;
+        }
+        put(static_cast<char>(v + 63));
+    };
+
+    long long prev_lat = 0, prev_lon = 0;
+    for (size_t i = 0; i < n; ++i) {
+        long long lat = std::llround(lats[i] * 1e5);
+        long long lon = std::llround(lons[i] * 1e5);
+        put_value(lat - prev_lat);
+        put_value(lon - prev_lon);
+        prev_lat = lat;
+        prev_lon = lon;
+    }
+
+    if (capacity > 0) out[std::min(length, capacity - 1)] = '\0';
+    return length;
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <vector>
+#include <cmath>
 #include <cstddef>
-#include <memory>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include "edge_weights.h"
 
 struct Edge {
     int id;
@@ -13,46 +18,149 @@ struct Edge {
 };
 
 struct Node {
-    int id;
     double lat;
     double lon;
-    std::vector<std::shared_ptr<Edge>> edges;
 };
 
 
+// Road graph in compressed-sparse-row form.
+//
+// Edges are collected with add_edge() and then packed by freeze(): the
+// outgoing edges of node i occupy the contiguous slots
+// [edge_begin(i), edge_end(i)) of the target/weight arrays. Node
+// coordinates are kept as separate latitude and longitude arrays; built
+// with ROUTING_COMPACT they are int32 fixed point in 1e-7 degrees (the
+// precision of OSM data) and edge weights are quantised too (EdgeWeights).
 class Graph {
 
     public:
         Graph() = default;
-        void add_node(int id, double lat, double lon);
-        void add_edge(int id, int from, int to, double weight);
+        // Nodes are numbered in the order they are added
+        void add_node(double lat, double lon);
+        // shape: intermediate points (lat, lon) of the road between the two
+        // nodes, in travel order, for geometry only; routing never sees them
+        void add_edge(int id, int from, int to, double weight,
+                      const std::vector<std::pair<double, double>>& shape = {});
         void update_edge_weight(int id, double new_weight);
 
+        // Pack the pending edges into CSR arrays. No edges may be added afterwards.
+        void freeze();
+        bool frozen() const { return frozen_; }
+
+        // Binary snapshot of a frozen graph, tagged with the hash of its source
+        bool save(const std::string& path, uint64_t source_hash) const;
+        bool load(const std::string& path, uint64_t source_hash);
 
-        const std::vector<Node>& nodes() const;
-        std::vector<Node>& nodes_mut();
-        std::vector<std::shared_ptr<Edge>>& edges_mut();
+        // Hash of topology and current weights; keys data derived from the graph
+        uint64_t fingerprint() const;
 
 
         // number of nodes
-        int num_nodes() const { return static_cast<int>(nodes_.size()); }
+        int num_nodes() const { return static_cast<int>(lat_.size()); }
+
+        // number of edge slots (valid once frozen)
+        int num_edges() const { return static_cast<int>(targets_.size()); }
+
+        // outgoing edge slots of a node
+        int edge_begin(int idx) const { return offsets_[idx]; }
+        int edge_end(int idx) const { return offsets_[idx + 1]; }
+
+        // incoming edges of a node, as forward edge slots
+        int in_begin(int idx) const { return in_offsets_[idx]; }
+        int in_end(int idx) const { return in_offsets_[idx + 1]; }
+        int in_slot(int i) const { return in_slots_[i]; }
+
+        // per-slot edge data
+        int edge_source(int slot) const { return sources_[slot]; }
+        int edge_target(int slot) const { return targets_[slot]; }
+        double edge_weight(int slot) const { return weights_.get(slot); }
+        int edge_id(int slot) const { return edge_ids_[slot]; }
+        Edge edge(int slot) const {
+            return {edge_ids_[slot], sources_[slot], targets_[slot], weights_.get(slot)};
+        }
+
+        // Weight updates publish a new version and are safe alongside
+        // readers. A search pins one version with weights() and reads every
+        // weight through it, so it never sees an update half applied.
+        void set_edge_weight(int slot, double weight);
+        // All (slot, weight) changes as one version; returns its number
+        uint64_t set_edge_weights(const std::vector<std::pair<int, double>>& updates);
+        EdgeWeights::Snapshot weights() const { return weights_.pin(); }
+        uint64_t weights_version() const { return weights_.version(); }
+
+        // Upper bound on straight-line metres covered per unit of weight over
+        // every edge, so haversine / max_speed() never overestimates a cost.
+        // Carried with each weight version (EdgeWeights::Snapshot::max_speed).
+        double max_speed() const { return weights_.pin().max_speed(); }
+
+        // Intermediate shape points of an edge (lat, lon), in travel order;
+        // replaces the contents of points. Empty for a straight edge.
+        void edge_shape(int slot, std::vector<std::pair<double, double>>& points) const;
+
+        // Edge slot lookups, -1 if absent. By id is a direct index; by endpoints
+        // scans the CSR row of `from`, which is bounded by the node degree.
+        int slot_of_id(int id) const;
+        int slot_of(int from, int to) const;
 
         // neighbors of a node (returns vector of {to, weight})
         std::vector<std::pair<int,double>> neighbors(int idx) const {
             std::vector<std::pair<int,double>> result;
-            for (const auto& e : nodes_[idx].edges) {
-                result.emplace_back(e->to, e->weight);
+            EdgeWeights::Snapshot weights = weights_.pin();
+            for (int e = offsets_[idx]; e < offsets_[idx + 1]; ++e) {
+                result.emplace_back(targets_[e], weights[e]);
             }
             return result;
         }
 
         // get node coordinates
-        double get_node_lat(int idx) const { return nodes_[idx].lat; }
-        double get_node_lon(int idx) const { return nodes_[idx].lon; }
+        double get_node_lat(int idx) const { return degrees(lat_[idx]); }
+        double get_node_lon(int idx) const { return degrees(lon_[idx]); }
+        Node node(int idx) const { return {get_node_lat(idx), get_node_lon(idx)}; }
 
 
     private:
-        std::vector<Node> nodes_;
-         std::vector<std::shared_ptr<Edge>> edges_;
-      
-};
\ No newline at end of file
+#ifdef ROUTING_COMPACT
+        using Coord = int32_t;
+        static Coord coord(double degrees) { return static_cast<Coord>(std::lround(degrees * 1e7)); }
+        static double degrees(Coord c) { return c / 1e7; }
+#else
+        using Coord = double;
+        static Coord coord(double degrees) { return degrees; }
+        static double degrees(Coord c) { return c; }
+#endif
+        std::vector<Coord> lat_;
+        std::vector<Coord> lon_;
+        std::vector<Edge> pending_;       // edges added before freeze()
+        std::vector<std::pair<double, double>> pending_shape_;
+        std::vector<size_t> pending_shape_end_;   // per pending edge
+
+        // CSR arrays, indexed by node (offsets_) or by edge slot (the rest)
+        std::vector<int> offsets_;
+        std::vector<int> sources_;
+        std::vector<int> targets_;
+        EdgeWeights weights_;
+        std::vector<int> edge_ids_;
+        bool frozen_ = false;
+
+        // Shape points of slot s are the bytes [shape_offsets_[s],
+        // shape_offsets_[s + 1]) of shape_data_: zigzag varint deltas in 1e-7
+        // degrees, lat then lon, starting from the source node
+        std::vector<uint32_t> shape_offsets_;
+        std::vector<uint8_t> shape_data_;
+
+        // straight-line metres per unit of weight if the slot had this weight
+        double speed_of(int slot, double weight) const;
+
+        // edge id -> first slot carrying it; dense when ids are compact
+        // (always the case after component filtering), hashed otherwise
+        std::vector<int> id_to_slot_;
+        std::unordered_map<int, int> sparse_id_to_slot_;
+        void build_id_index();
+
+        // reverse CSR: incoming edges of node v are in_slots_[in_offsets_[v] ..
+        // in_offsets_[v + 1]), each naming the forward slot so weights stay shared
+        std::vector<int> in_offsets_;
+        std::vector<int> in_slots_;
+        void build_reverse_index();
+
+};
@@ -2,6 +2,7 @@
 
 #include <unordered_map>
 #include <vector>
+#include <string>
 
 #include "graph.h"
 #include "osm_parser.h"   // OK here, used only for data types
@@ -12,6 +13,11 @@ class GraphBuilder {
         GraphBuilder(std::unordered_map<int64_t, OSMNode>&& nodes, std::vector<OSMWay>&& ways) : nodes_(std::move(nodes)), ways_(std::move(ways)) {}
         // static Graph build();
 
+        // Routing graph for an OSM extract. Uses the snapshot cached next to it
+        // (<osm_file>.graph) when it matches the file's hash, otherwise parses the
+        // extract, builds the graph and refreshes the snapshot.
+        static Graph load_or_build(const std::string& osm_file);
+
         std::unordered_map<int64_t, int> find_intersections();
         double haversine(OSMNode& n1, OSMNode& n2);
         Graph build_graph();  
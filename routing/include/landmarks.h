@@ -0,0 +1,48 @@
+#pragma once
+
+#include "graph.h"
+#include <vector>
+
+
+// Landmark distance tables for ALT (A*, landmarks, triangle inequality).
+//
+// For every landmark L the table holds d(L, v) and d(v, L) for all nodes v,
+// from one forward and one backward Dijkstra. By the triangle inequality
+//     d(v, t) >= d(L, t) - d(L, v)   and   d(v, t) >= d(v, L) - d(t, L),
+// so the largest of these over all landmarks is a lower bound on the cost of
+// reaching t, measured in the graph's own weight units.
+//
+// Distances are stored as floats, node-major (all landmarks of a node are
+// adjacent), and the bound is shaved by the float rounding error so it stays
+// admissible. Tables built on one set of weights give valid bounds for any
+// weights at or above them, edge by edge; RoutingEngine builds them on the
+// lowest weight each edge has had so that most updates keep them valid.
+class Landmarks {
+public:
+    enum struct Selection {
+        Farthest,   // each landmark is the node farthest from those chosen so far
+        Avoid,      // grow landmarks into the regions the current set covers worst
+    };
+
+    Landmarks() = default;
+    explicit Landmarks(const Graph& graph, int count = 16,
+                       Selection selection = Selection::Avoid);
+
+    // Tables over the given per-slot weights instead of the graph's current ones
+    Landmarks(const Graph& graph, const std::vector<double>& weights, int count = 16,
+              Selection selection = Selection::Avoid);
+
+    bool empty() const { return landmarks_.empty(); }
+    int count() const { return static_cast<int>(landmarks_.size()); }
+    const std::vector<int>& nodes() const { return landmarks_; }
+
+    // Lower bound on the cost of travelling from v to t
+    double lower_bound(int v, int t) const;
+
+private:
+    std::vector<int> landmarks_;
+
+    // from_[v * K + k] = d(L_k, v), to_[v * K + k] = d(v, L_k)
+    std::vector<float> from_;
+    std::vector<float> to_;
+};
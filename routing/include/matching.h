@@ -38,6 +38,7 @@ struct Driver {
     int id;
     double ask;
     Location loc;
+    int node = -1;           // graph node the location snaps to, -1 if unsnapped
     std::atomic<State> state{State::OPEN};
     std::vector<int> inbox;  // Rider IDs that sent offers
     
@@ -70,6 +71,8 @@ private:
     
     // Helper functions
     std::vector<int> find_k_closest_drivers(const Rider& rider, int k);
+    std::vector<int> find_k_closest_by_road(const Rider& rider, int k);
+    void remove_from_node_index(const Driver& driver);
     void send_offers(int rider_id, const std::vector<int>& driver_ids);
     void cleanup_after_match(int rider_id, int driver_id);
     
@@ -82,6 +85,7 @@ private:
     std::unordered_map<int, Rider> riders_;
     std::unordered_map<int, Driver> drivers_;
     std::unordered_map<H3Index, std::vector<int>> drivers_by_cell_;
+    std::unordered_map<int, std::vector<int>> drivers_by_node_;  // snapped drivers
     
     // Threading
     std::vector<std::thread> workers_;
@@ -103,6 +107,7 @@ private:
     // static constexpr int H3_RES = 10;
     static constexpr int K = 5;
     static constexpr int TIMEOUT_SEC = 300;
+    static constexpr double MAX_PICKUP_SEC = 900.0;  // road-search cutoff for drivers
 
     // In matching.h
 static constexpr int H3_RES = 8;  // Lower resolution = larger cells
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+
+// Override layers, lowest precedence first
+enum struct OverrideLayer {
+    Traffic,    // live speeds (TrafficModel)
+    Incident,   // closures and slowdowns, usually with an expiry
+    Manual,     // explicit update_edge calls
+};
+
+
+// Sparse per-slot weight overrides in layers on top of immutable baseline
+// weights.
+//
+// A slot's effective weight is its override in the highest layer that has
+// one, else the baseline. Routing never reads the overlay: RoutingEngine
+// writes effective weights into the graph whenever overrides change, so the
+// hot path stays a plain array read. Each mutator appends the slots whose
+// effective weight may have changed to `touched`.
+class WeightOverlay {
+public:
+    static constexpr int NUM_LAYERS = 3;
+
+    WeightOverlay() = default;
+    explicit WeightOverlay(std::vector<double> baseline);
+
+    double baseline(int slot) const { return baseline_[slot]; }
+    double effective(int slot) const;
+    size_t size(OverrideLayer layer) const { return layers_[index(layer)].size(); }
+
+    // expires is in Unix seconds; 0 never expires
+    void set(OverrideLayer layer, int slot, double weight, double expires,
+             std::vector<int>& touched);
+    void clear(OverrideLayer layer, int slot, std::vector<int>& touched);
+
+    // Every override of a layer, in time proportional to their number
+    void clear(OverrideLayer layer, std::vector<int>& touched);
+
+    // Drop overrides whose expiry is at or before now
+    void expire(double now, std::vector<int>& touched);
+
+    // Earliest pending expiry, infinity if none; may belong to an override
+    // replaced since, so it is never later than the real one
+    double next_expiry() const;
+
+    // Overrides of every layer, tied to the baseline they were made against
+    bool save(const std::string& path) const;
+    bool load(const std::string& path, std::vector<int>& touched);
+
+private:
+    struct Override {
+        double weight;
+        double expires;
+    };
+
+    std::vector<double> baseline_;
+    std::unordered_map<int, Override> layers_[NUM_LAYERS];
+
+    // (expires, layer, slot); entries whose override was replaced or
+    // cleared since are skipped when they come due
+    using Expiry = std::tuple<double, int, int>;
+    std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> expiries_;
+
+    static int index(OverrideLayer layer) { return static_cast<int>(layer); }
+    uint64_t baseline_hash() const;
+};
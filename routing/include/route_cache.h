@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+
+// Bounded LRU cache of route costs keyed by snapped (start, goal) node pair.
+//
+// Each entry keeps the sorted edge slots of its path and how far it has been
+// checked against a log of weight changes. Publishing weights only appends
+// the changed slots to the log; entries are validated lazily when looked up,
+// against the changes logged since their last check:
+//
+//   - an increase on one of the entry's own slots drops it; increases
+//     elsewhere cannot make its path suboptimal
+//   - a decrease drops it only if the caller's may_improve() says a path
+//     over that edge could now undercut the cached cost (RoutingEngine tests
+//     a lower bound through the edge)
+//
+// An entry that passes is stamped as checked up to the newest change, so
+// each change is tested at most once per entry. One that has fallen more
+// than MAX_CHECK changes behind is treated as a miss, as recomputing the
+// route is then cheaper than checking it.
+//
+// Under live traffic a flush changes a few hundred to a few thousand scattered
+// edges. Increases then cost only the routes that use them, and decreases only
+// routes passing close to the edge, so entries survive flushes instead of all
+// going at the first decrease. Entries unused for more than a few flushes
+// (MAX_CHECK changes) miss.
+//
+// Capacity counts edge slots over all cached paths (plus one per entry), so
+// memory stays bounded whatever the route lengths: about 4 bytes per slot
+// and 100 per entry.
+class RouteCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;   // entries dropped by weight changes
+        size_t size;              // entries
+        size_t slots;             // path slots held by them
+    };
+
+    // (start, goal, cached cost, decreased slot) -> whether the slot's new
+    // weight could give a cheaper route
+    using MayImprove = std::function<bool(int, int, double, int)>;
+
+    // A capacity of 0 disables the cache
+    explicit RouteCache(size_t capacity = 0);
+
+    // Drop everything and change the capacity. Not safe concurrently with
+    // other calls.
+    void reset(size_t capacity);
+    bool enabled() const { return capacity_ > 0; }
+
+    // Cost of a cached pair that is still valid; counts a hit or a miss
+    bool lookup(int start, int goal, double& cost, const MayImprove& may_improve);
+
+    // Read before the route's weights are pinned and pass to insert()
+    uint64_t stamp() const { return logged_.load(std::memory_order_acquire); }
+
+    // Cache a route computed after stamp() returned `stamp`, along with the
+    // edge slots its path uses
+    void insert(int start, int goal, double cost, std::vector<int> slots, uint64_t stamp);
+
+    // Log the slots whose weight went up / down, after they are published
+    void record(const std::vector<int>& increased, const std::vector<int>& decreased);
+    void clear();
+
+    Stats stats() const;
+
+private:
+    static constexpr int NUM_SHARDS = 16;
+    static constexpr uint64_t LOG_SIZE = 1 << 16;
+    static constexpr uint64_t MAX_CHECK = 4096;
+
+    struct Entry {
+        uint64_t key;
+        double cost;
+        uint64_t checked;         // changes logged before this are accounted for
+        std::vector<int> slots;   // sorted
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;     // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t slots = 0;         // charged against the capacity
+
+        void erase(std::list<Entry>::iterator it);
+    };
+
+    struct Change {
+        int slot;
+        bool decreased;
+    };
+
+    size_t capacity_ = 0;
+    size_t shard_capacity_ = 0;
+    std::unique_ptr<Shard[]> shards_;
+
+    // Ring of the last LOG_SIZE changes; logged_ counts every change so far
+    mutable std::shared_mutex log_mutex_;
+    std::vector<Change> log_;
+    std::atomic<uint64_t> logged_{0};
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> invalidations_{0};
+
+    static uint64_t key_of(int start, int goal) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(start)) << 32) |
+               static_cast<uint32_t>(goal);
+    }
+    static size_t charge(const Entry& entry) { return entry.slots.size() + 1; }
+    Shard& shard_of(uint64_t key) const;
+    bool still_valid(Entry& entry, const MayImprove& may_improve) const;
+};
@@ -1,6 +1,23 @@
 #pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include "graph.h"
 #include "astar.h"
+#include "ch.h"
+#include "cch.h"
+#include "spatial_index.h"
+#include "route_cache.h"
+#include "update_queue.h"
+#include "overlay.h"
 
 
 enum struct Direction {
@@ -10,24 +27,239 @@ enum struct Direction {
 
 };
 
+// Queries and edge updates may run concurrently from any number of threads:
+// every search pins one version of the edge weights (see EdgeWeights), and
+// updates publish new versions without blocking readers. The prepare_* and
+// enable_* calls are setup steps and must not race with queries.
 class RoutingEngine {
 public:
     RoutingEngine(Graph graph);
+    ~RoutingEngine();
+
+    // The update_edge / update_edges family sets overrides in the Manual
+    // layer; the graph's weights at construction are the baseline beneath
+    // every layer (see WeightOverlay). These overrides never expire and hide
+    // the Traffic and Incident layers until removed with clear_overrides() or
+    // clear_layer(); writing a "normal" weight back does not undo them.
     void update_edge(double lat, double lon, double weight, Direction dir = Direction::BOTH);
     void update_edge(int id, double weight);
     void update_edge(int from, int to, double weight);
+
+    // Apply many weight changes as one atomic step: a query sees all of them
+    // or none. Edges are named by id, or by (from, to) node pair; unknown
+    // ones are skipped. Returns the number applied.
+    int update_edges(const int* ids, const double* weights, int count);
+    int update_edges(const int* from, const int* to, const double* weights, int count);
+
+    // Queue a change from any thread without blocking; false if the edge is
+    // unknown or the queue is full. flush_updates() applies everything queued
+    // so far as one batch and returns how many changes that was.
+    bool enqueue_update(int id, double weight);
+    int flush_updates();
+
+    // Set and clear overrides of one layer by edge slot, published together
+    // as one weight version. expires is in Unix seconds, 0 for never.
+    void apply_overrides(OverrideLayer layer, const std::vector<std::pair<int, double>>& set,
+                         const std::vector<int>& cleared = {}, double expires = 0.0);
+
+    // The same by edge id; unknown ids are skipped. Return the number applied.
+    int set_overrides(OverrideLayer layer, const int* ids, const double* weights, int count,
+                      double expires = 0.0);
+    int clear_overrides(OverrideLayer layer, const int* ids, int count);
+
+    // The same for every edge with some part inside a circle (radius in
+    // metres) or a polygon of (lat, lon) vertices, found through the edge
+    // index. scale_* sets the baseline weight times factor; an infinite
+    // weight closes the edges. Return the number of edges.
+    int set_overrides_in_radius(OverrideLayer layer, double lat, double lon, double radius_m,
+                                double weight, double expires = 0.0);
+    int scale_overrides_in_radius(OverrideLayer layer, double lat, double lon, double radius_m,
+                                  double factor, double expires = 0.0);
+    int clear_overrides_in_radius(OverrideLayer layer, double lat, double lon, double radius_m);
+    int set_overrides_in_polygon(OverrideLayer layer,
+                                 const std::vector<std::pair<double, double>>& polygon,
+                                 double weight, double expires = 0.0);
+    int scale_overrides_in_polygon(OverrideLayer layer,
+                                   const std::vector<std::pair<double, double>>& polygon,
+                                   double factor, double expires = 0.0);
+    int clear_overrides_in_polygon(OverrideLayer layer,
+                                   const std::vector<std::pair<double, double>>& polygon);
+
+    // Drop every override of a layer, restoring whatever lies beneath;
+    // returns how many there were
+    int clear_layer(OverrideLayer layer);
+
+    // Drop overrides that expired at or before now; returns how many. Timed
+    // overrides also expire on their own: the first one starts a timer
+    // thread that sleeps until the earliest expiry, so they are dropped
+    // within milliseconds of it, with or without a TrafficModel.
+    int expire_overrides(double now);
+
+    // Overrides of every layer to / from a snapshot file, which only loads
+    // against the same baseline weights
+    bool save_overrides(const std::string& path);
+    bool load_overrides(const std::string& path);
+
+    // Weight of an edge slot before any override
+    double baseline_weight(int slot) const { return overlay_.baseline(slot); }
     bool matches_direction(double from_lat, double from_lon, double to_lat, double to_lon, Direction dir = Direction::BOTH);
     double route(double lat1, double lon1,
-                 double lat2, double lon2);
+                 double lat2, double lon2,
+                 SearchMode mode = SearchMode::AStar);
+
+    // Full route into caller buffers of `capacity` entries (any may be null):
+    // graph node indices, their coordinates, and edge_costs[i] for the hop
+    // from node i to node i + 1. Returns the number of path nodes, which may
+    // exceed capacity (retry with larger buffers); 0 if the goal is
+    // unreachable, -1 if a point cannot be snapped.
+    int route_path(double lat1, double lon1, double lat2, double lon2,
+                   int* nodes, double* lats, double* lons, double* edge_costs,
+                   int capacity, double* total_cost = nullptr,
+                   SearchMode mode = SearchMode::AStar);
+
+    // Road geometry of the route (nodes plus the shape points between them)
+    // into caller buffers; returns the number of points, which may exceed
+    // capacity, 0 if unreachable, -1 if a point cannot be snapped
+    int route_geometry(double lat1, double lon1, double lat2, double lon2,
+                       double* lats, double* lons, int capacity,
+                       SearchMode mode = SearchMode::AStar);
+
+    // The route's road geometry as an encoded polyline in a caller buffer;
+    // returns the full encoded length (see encode_polyline), 0 with an empty
+    // string if unreachable, -1 if a point cannot be snapped
+    int route_polyline(double lat1, double lon1, double lat2, double lon2,
+                       char* out, int capacity, SearchMode mode = SearchMode::AStar);
+
+    // Cost of the route if it is at most max_cost, otherwise infinity (also
+    // when unreachable); -1 if a point cannot be snapped. The search stops as
+    // soon as no path within the bound can remain.
+    double route_within(double lat1, double lon1,
+                        double lat2, double lon2, double max_cost);
+
+    // Travel costs from every source point to every target point, as a dense
+    // row-major matrix (row i holds source i). Points that cannot be snapped
+    // give -1 like route(); unreachable pairs give infinity. Uses the
+    // customizable hierarchy when prepared, else one Dijkstra per source.
+    std::vector<double> route_matrix(const std::vector<std::pair<double, double>>& sources,
+                                     const std::vector<std::pair<double, double>>& targets);
+
+    // Prepare the contraction hierarchy used by SearchMode::CH: loaded from
+    // cache_file when it was built for exactly this graph, otherwise built and
+    // written there. Weight updates make it stale until prepared again.
+    bool prepare_hierarchy(const std::string& cache_file = "");
+    bool hierarchy_ready() const { return !ch_.empty() && !ch_stale_.load(); }
+
+    // Prepare the customizable hierarchy used by SearchMode::CCH. It follows
+    // weight updates: changed edges are re-customized before the next query.
+    bool prepare_customizable_hierarchy(int num_threads = 0);
+    bool customizable_hierarchy_ready() const { return !cch_.empty(); }
+
+    // Select landmarks and build the distance tables used by SearchMode::ALT.
+    // The tables are built on the lowest weight each edge has had, so they
+    // stay valid while weights move above that. A weight dropping below it
+    // makes them stale; they are rebuilt on a background thread with the
+    // lowered floor and swapped in, and ALT runs as plain A* meanwhile.
+    bool prepare_landmarks(int count = 16);
+    bool landmarks_ready() const {
+        std::shared_ptr<const Landmarks> landmarks = std::atomic_load(&landmarks_);
+        return !landmarks_stale_.load() && landmarks && !landmarks->empty();
+    }
+
+    // Priority queue of the graph searches (A*, ALT, Dijkstra, isochrones,
+    // one-to-many without the CCH); hierarchy queries are unaffected
+    void set_queue(QueueKind kind) { queue_kind_ = kind; }
+    QueueKind queue() const { return queue_kind_; }
+
+    // Cache route() costs by snapped node pair, holding paths of up to
+    // capacity edge slots in total (0 turns it off). Entries are checked
+    // against later edge updates when looked up (see RouteCache).
+    void enable_route_cache(size_t capacity);
+    RouteCache::Stats route_cache_stats() const { return route_cache_.stats(); }
+
+    // Graph node a point snaps to, -1 if none
+    int nearest_node(double lat, double lon) const { return find_nearest_node(lat, lon); }
+
+    // Nodes in order of their road cost to reach the node a point snaps to,
+    // until visit(node, cost) returns false
+    void scan_toward(double lat, double lon,
+                     const std::function<bool(int, double)>& visit) const;
+
+    // Isochrone: graph nodes reachable from a point within max_cost, cheapest
+    // first. With toward = true, the nodes that can reach the point instead.
+    std::vector<int> isochrone(double lat, double lon, double max_cost,
+                               bool toward = false) const;
+
+    // The same set as a bitmap over graph nodes: bit v % 64 of word v / 64
+    std::vector<uint64_t> isochrone_bitmap(double lat, double lon, double max_cost,
+                                           bool toward = false) const;
+
+    // The same set as the sorted H3 cells (at the given resolution) that
+    // contain at least one of its nodes
+    std::vector<uint64_t> isochrone_cells(double lat, double lon, double max_cost,
+                                          int resolution, bool toward = false) const;
+
+    // Up to k graph nodes closest to a point, nearest first
+    std::vector<int> nearest_nodes(double lat, double lon, int k) const;
     
 
     Graph view_graph() {return graph_;}
+    const Graph& graph() const { return graph_; }
 
 private:
     Graph graph_;
+    NodeIndex node_index_;
+    EdgeIndex edge_index_;
+    ContractionHierarchy ch_;
+    std::atomic<bool> ch_stale_{true};
+    std::shared_ptr<const Landmarks> landmarks_;   // swapped with std::atomic_store
+    std::atomic<bool> landmarks_stale_{true};
+    std::atomic<uint64_t> landmark_breaks_{0};     // publishes below landmark_floor_
+    std::vector<double> landmark_floor_;           // metric of the tables, under update_mutex_
+    int landmark_count_ = 0;
+    bool landmarks_building_ = false;              // under update_mutex_
+    std::thread landmark_builder_;
+    RouteCache route_cache_;
+    std::atomic<QueueKind> queue_kind_{QueueKind::Quaternary};
+    std::mutex update_mutex_;        // guards overlay_, serializes weight publishing
+    WeightOverlay overlay_;
+    std::thread expiry_timer_;       // started with the first timed override
+    std::condition_variable expiry_cv_;
+    bool stopping_ = false;          // under update_mutex_
+    UpdateQueue update_queue_;
+    std::mutex flush_mutex_;         // one consumer of update_queue_ at a time
+
+    // Queries share cch_mutex_; customizing the metric takes it exclusively
+    CustomizableCH cch_;
+    std::shared_mutex cch_mutex_;
+    std::mutex cch_pending_mutex_;
+    std::vector<int> cch_pending_;   // slots updated since the last customization
+    std::atomic<bool> cch_dirty_{false};
 
     int find_nearest_node(double lat, double lon) const;
+    SearchContext& search_context(int slot = 0) const;
     std::vector<int> find_nearest_edge(double lat, double lon, Direction dir = Direction::BOTH);
+    void publish_weights(const std::vector<std::pair<int, double>>& updates);
+    void publish_effective(std::vector<int>& touched);
+    void schedule_expiry();
+    void run_expiry_timer();
+    std::vector<int> slots_in_radius(double lat, double lon, double radius_m) const;
+    int set_area_overrides(OverrideLayer layer, const std::vector<int>& slots,
+                           double value, bool scale, double expires);
+    void apply_customization();
+    double lower_bound(int from, int to) const;
+    bool may_improve_route(int start, int goal, double cost, int slot) const;
+    void build_landmarks();
+    void rebuild_landmarks();
+    AStarResult find_path(int start, int goal, SearchMode mode,
+                          const EdgeWeights::Snapshot& weights);
+    AStarResult find_path_alt(int start, int goal, double max_cost,
+                              const EdgeWeights::Snapshot& weights);
+    std::vector<int> path_slots(const std::vector<int>& path) const;
+    // Cheapest parallel edge of a hop
+    int hop_slot(int from, int to, const EdgeWeights::Snapshot& weights) const;
+    double hop_cost(int from, int to, const EdgeWeights::Snapshot& weights) const;
+    void path_geometry(const std::vector<int>& path, const EdgeWeights::Snapshot& weights,
+                       std::vector<double>& lats, std::vector<double>& lons) const;
 
 
 };
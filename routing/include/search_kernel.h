@@ -0,0 +1,239 @@
+#pragma once
+
+#include "astar.h"
+#include "graph.h"
+#include "geo.h"
+#include "landmarks.h"
+#include "search_queue.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+
+// Policies for SearchKernel. A search is an instantiation over one of each:
+//
+//   Edges      which way edges are followed: OutEdges or InEdges
+//   Heuristic  lower bound on the cost from a node to the target:
+//              ZeroHeuristic, GeoHeuristic or LandmarkHeuristic
+//   Stop       when to end the search and which entries to queue at all:
+//              StopAtGoal, StopAtGoalWithin, StopAtTargets or VisitUntil
+//
+// plus a queue policy (search_queue.h) and a weight array, both deduced from
+// the arguments. Every choice is made at compile time, so the relaxation
+// loop has no branches on the kind of search; a new query type is a new
+// policy, not a new loop.
+
+
+// Outgoing edges, searching away from the origin
+struct OutEdges {
+    template <typename F>
+    static void for_each(const Graph& graph, int v, F&& f) {
+        for (int slot = graph.edge_begin(v); slot < graph.edge_end(v); ++slot) {
+            f(slot, graph.edge_target(slot));
+        }
+    }
+};
+
+// Incoming edges, searching backwards toward the origin
+struct InEdges {
+    template <typename F>
+    static void for_each(const Graph& graph, int v, F&& f) {
+        for (int i = graph.in_begin(v); i < graph.in_end(v); ++i) {
+            int slot = graph.in_slot(i);
+            f(slot, graph.edge_source(slot));
+        }
+    }
+};
+
+
+// Dijkstra. A zero heuristic is consistent, so settled nodes stay settled
+// and the kernel skips the reopen bookkeeping.
+struct ZeroHeuristic {
+    static constexpr bool zero = true;
+    double operator()(int) const { return 0.0; }
+};
+
+// Haversine distance to the goal at the top speed of the pinned weights
+struct GeoHeuristic {
+    static constexpr bool zero = false;
+
+    const Graph& graph;
+    Node goal;
+    double max_speed;
+
+    double operator()(int v) const {
+        if (max_speed <= 0.0) return 0.0;
+        return haversine(graph.get_node_lat(v), graph.get_node_lon(v), goal.lat, goal.lon) /
+               max_speed;
+    }
+};
+
+// ALT bounds; infinity marks a node the goal cannot be reached from
+struct LandmarkHeuristic {
+    static constexpr bool zero = false;
+
+    const Landmarks& landmarks;
+    int goal;
+
+    double operator()(int v) const { return landmarks.lower_bound(v, goal); }
+};
+
+
+// Stop once the goal is settled
+struct StopAtGoal {
+    int goal;
+
+    bool admit(double) const { return true; }
+    bool settle(int v, double) const { return v != goal; }
+};
+
+// The same, never queueing a path whose estimate exceeds max_cost
+struct StopAtGoalWithin {
+    int goal;
+    double max_cost;
+
+    bool admit(double key) const { return key <= max_cost; }
+    bool settle(int v, double) const { return v != goal; }
+};
+
+// Stop once every target is settled; targets sorted and unique
+struct StopAtTargets {
+    const std::vector<int>& targets;
+    size_t remaining;
+
+    bool admit(double) const { return true; }
+    bool settle(int v, double) {
+        if (std::binary_search(targets.begin(), targets.end(), v)) --remaining;
+        return remaining > 0;
+    }
+};
+
+// Pass each settled node to visit(node, cost) until it returns false
+template <typename Visit>
+struct VisitUntil {
+    Visit& visit;
+
+    bool admit(double) const { return true; }
+    bool settle(int v, double cost) { return visit(v, cost); }
+};
+
+
+template <typename Edges, typename Heuristic, typename Stop>
+class SearchKernel {
+public:
+    // Search from origin over ctx, settling nodes in order of cost plus
+    // heuristic, reading weights[slot] as a cost in the heuristic's units
+    // (seconds for EdgeWeights::Snapshot, in every build).
+    template <typename Queue, typename Weights>
+    static void run(const Graph& graph, const Weights& weights, int origin,
+                    SearchContext& ctx, Queue& open,
+                    const Heuristic& heuristic, Stop& stop) {
+        int N = graph.num_nodes();
+        ctx.reset(N);
+        open.reset(N);
+
+        ctx.reach(origin, 0.0, -1);
+        double h_origin = heuristic(origin);
+        if (stop.admit(h_origin)) {
+            open.push(origin, h_origin);
+        }
+
+        while (!open.empty()) {
+            int current = open.pop();
+
+            if (ctx.closed(current)) continue;
+            ctx.close(current);
+
+            double g_current = ctx.g(current);
+            if (!stop.settle(current, g_current)) break;
+
+            Edges::for_each(graph, current, [&](int slot, int neighbor) {
+                double tentative_g = g_current + static_cast<double>(weights[slot]);
+                if (!(tentative_g < ctx.g(neighbor))) return;
+
+                double key = tentative_g;
+                if constexpr (!Heuristic::zero) {
+                    double h = heuristic(neighbor);
+                    if (h == std::numeric_limits<double>::infinity()) return;  // target unreachable
+                    key += h;
+                }
+                if (!stop.admit(key)) return;
+
+                ctx.reach(neighbor, tentative_g, current);
+                if constexpr (!Heuristic::zero) {
+                    // With a consistent heuristic a closed node is never
+                    // improved; the float-rounded landmark bounds can be off
+                    // by a hair
+                    ctx.reopen(neighbor);
+                }
+                open.push(neighbor, key);
+            });
+        }
+    }
+};
+
+
+// Bidirectional Dijkstra over two contexts and two queues of one policy:
+// grows a forward search from start and a backward one from goal, and stops
+// once the two queue minima together can no longer improve the best meeting
+// point. Returns the meeting node, -1 when there is no path; cost is set to
+// the path cost.
+template <typename Queue, typename Weights>
+int bidirectional_search(const Graph& graph, const Weights& weights, int start, int goal,
+                         SearchContext& forward, Queue& fq,
+                         SearchContext& backward, Queue& bq, double& cost) {
+    const double INF = std::numeric_limits<double>::infinity();
+    int N = graph.num_nodes();
+
+    forward.reset(N);
+    backward.reset(N);
+    fq.reset(N);
+    bq.reset(N);
+    forward.reach(start, 0.0, -1);
+    backward.reach(goal, 0.0, -1);
+    fq.push(start, 0.0);
+    bq.push(goal, 0.0);
+
+    cost = start == goal ? 0.0 : INF;
+    int meet = start == goal ? start : -1;
+
+    // One side's step, with the direction fixed at compile time
+    auto expand = [&](auto edges, SearchContext& self, Queue& q, SearchContext& other) {
+        int current = q.pop();
+        if (self.closed(current)) return;
+        self.close(current);
+
+        double g_current = self.g(current);
+        decltype(edges)::for_each(graph, current, [&](int slot, int neighbor) {
+            if (self.closed(neighbor)) return;
+
+            double tentative_g = g_current + static_cast<double>(weights[slot]);
+            if (tentative_g < self.g(neighbor)) {
+                self.reach(neighbor, tentative_g, current);
+                q.push(neighbor, tentative_g);
+            }
+
+            if (other.reached(neighbor)) {
+                double through = self.g(neighbor) + other.g(neighbor);
+                if (through < cost) {
+                    cost = through;
+                    meet = neighbor;
+                }
+            }
+        });
+    };
+
+    while (!fq.empty() || !bq.empty()) {
+        double f_top = fq.empty() ? INF : fq.min_key();
+        double b_top = bq.empty() ? INF : bq.min_key();
+        if (f_top + b_top >= cost) break;
+
+        // Expand the side with the smaller frontier key
+        if (f_top <= b_top) {
+            expand(OutEdges(), forward, fq, backward);
+        } else {
+            expand(InEdges(), backward, bq, forward);
+        }
+    }
+    return meet;
+}
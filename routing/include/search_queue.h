@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+
+// Priority queue policies for the graph searches in AStar.
+//
+// Each policy is a class with the same small interface, so the search loops
+// are templates over it and get the queue inlined:
+//
+//   reset(num_nodes)    empty the queue for a search over num_nodes nodes
+//   empty()
+//   push(node, key)     insert node, or lower its key if already queued
+//   min_key()           smallest key; the queue must not be empty
+//   pop()               remove an entry with the smallest key, return its node
+//
+// Keys are non-negative costs. The lazy heap may hold a node several times,
+// so searches still skip nodes they have already closed.
+
+
+// Binary heap with lazy deletion: an improved node is pushed again and its
+// old entries are skipped when they surface, so it can grow well past the
+// frontier.
+class BinaryHeap {
+public:
+    void reset(int) { heap_.clear(); }
+    bool empty() const { return heap_.empty(); }
+
+    void push(int node, double key) {
+        heap_.push_back({key, node});
+        std::push_heap(heap_.begin(), heap_.end(), std::greater<Entry>());
+    }
+
+    double min_key() const { return heap_.front().key; }
+
+    int pop() {
+        std::pop_heap(heap_.begin(), heap_.end(), std::greater<Entry>());
+        int node = heap_.back().node;
+        heap_.pop_back();
+        return node;
+    }
+
+private:
+    struct Entry {
+        double key;
+        int node;
+
+        bool operator>(const Entry& other) const { return key > other.key; }
+    };
+    std::vector<Entry> heap_;
+};
+
+
+// Indexed 4-ary heap with decrease-key: every node is queued at most once,
+// so the heap never grows past the frontier. Wider nodes make the tree
+// shallower and keep a sift-down's children in one cache line.
+class QuaternaryHeap {
+public:
+    void reset(int num_nodes) {
+        if (static_cast<int>(pos_.size()) != num_nodes) {
+            pos_.assign(num_nodes, -1);
+        } else {
+            // Only entries left over from an early stop still have a position
+            for (const Entry& e : heap_) pos_[e.node] = -1;
+        }
+        heap_.clear();
+    }
+
+    bool empty() const { return heap_.empty(); }
+
+    void push(int node, double key) {
+        int i = pos_[node];
+        if (i < 0) {
+            i = static_cast<int>(heap_.size());
+            heap_.push_back({key, node});
+        } else if (key >= heap_[i].key) {
+            return;
+        }
+        sift_up(i, {key, node});
+    }
+
+    double min_key() const { return heap_.front().key; }
+
+    int pop() {
+        int node = heap_.front().node;
+        pos_[node] = -1;
+
+        Entry last = heap_.back();
+        heap_.pop_back();
+        if (!heap_.empty()) sift_down(0, last);
+        return node;
+    }
+
+private:
+    struct Entry {
+        double key;
+        int node;
+    };
+    std::vector<Entry> heap_;
+    std::vector<int> pos_;   // index in heap_ per node, -1 when not queued
+
+    void place(int i, const Entry& e) {
+        heap_[i] = e;
+        pos_[e.node] = i;
+    }
+
+    void sift_up(int i, Entry e) {
+        while (i > 0) {
+            int parent = (i - 1) / 4;
+            if (heap_[parent].key <= e.key) break;
+            place(i, heap_[parent]);
+            i = parent;
+        }
+        place(i, e);
+    }
+
+    void sift_down(int i, Entry e) {
+        int n = static_cast<int>(heap_.size());
+        while (true) {
+            int first = 4 * i + 1;
+            if (first >= n) break;
+
+            int best = first;
+            int last = first + 4 < n ? first + 4 : n;
+            for (int c = first + 1; c < last; ++c) {
+                if (heap_[c].key < heap_[best].key) best = c;
+            }
+            if (e.key <= heap_[best].key) break;
+            place(i, heap_[best]);
+            i = best;
+        }
+        place(i, e);
+    }
+};
+
+
+// Monotone radix heap: keys popped never decrease, which holds for Dijkstra
+// and for A* with a consistent heuristic. Entries sit in buckets by the
+// highest bit in which their key differs from the last key popped, so each
+// entry moves down at most 64 times over a search instead of paying a log n
+// sift on every push.
+//
+// Keys are bucketed by their IEEE bit pattern, which orders non-negative
+// doubles like their values; integer-quantised weights give the shortest
+// redistributions but any non-negative key is exact. A key below the last
+// one popped (a landmark bound rounded the wrong way) is queued at that
+// last key. Lazy like BinaryHeap.
+class RadixHeap {
+public:
+    void reset(int) {
+        for (auto& bucket : buckets_) bucket.clear();
+        last_ = 0;
+        size_ = 0;
+    }
+
+    bool empty() const { return size_ == 0; }
+
+    void push(int node, double key) {
+        uint64_t bits = key_bits(key);
+        if (bits < last_) bits = last_;
+        buckets_[bucket_of(bits)].push_back({bits, node});
+        ++size_;
+    }
+
+    double min_key() {
+        refill();
+        double key;
+        std::memcpy(&key, &last_, sizeof(key));
+        return key;
+    }
+
+    int pop() {
+        refill();
+        int node = buckets_[0].back().node;
+        buckets_[0].pop_back();
+        --size_;
+        return node;
+    }
+
+private:
+    struct Entry {
+        uint64_t bits;
+        int node;
+    };
+    std::vector<Entry> buckets_[65];
+    uint64_t last_ = 0;
+    size_t size_ = 0;
+
+    static uint64_t key_bits(double key) {
+        uint64_t bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        return bits;
+    }
+
+    int bucket_of(uint64_t bits) const {
+        return bits == last_ ? 0 : 64 - __builtin_clzll(bits ^ last_);
+    }
+
+    // Make bucket 0 hold the minimum: advance last_ to the smallest key of
+    // the first non-empty bucket and spread that bucket over lower ones
+    void refill() {
+        if (!buckets_[0].empty()) return;
+
+        int b = 1;
+        while (buckets_[b].empty()) ++b;
+
+        uint64_t min_bits = buckets_[b].front().bits;
+        for (const Entry& e : buckets_[b]) {
+            if (e.bits < min_bits) min_bits = e.bits;
+        }
+        last_ = min_bits;
+
+        std::vector<Entry> moving;
+        moving.swap(buckets_[b]);
+        for (const Entry& e : moving) buckets_[bucket_of(e.bits)].push_back(e);
+        moving.clear();
+        moving.swap(buckets_[b]);   // keep the capacity
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// 64-bit FNV-1a over a byte range, consumed a word at a time
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+// Hash of a whole file's contents (0 if it cannot be read)
+uint64_t hash_file(const std::string& path);
+
+
+// Read-only memory mapping of a file. Pages are shared with every other
+// process mapping the same file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool valid() const { return data_ != nullptr; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+
+// Sectioned binary snapshot files.
+//
+// Layout: a fixed header (magic, kind, version, byte-order mark, source
+// hash, payload checksum) followed by tagged sections, each padded to 8
+// bytes. Values are stored in native byte order; a file written on a machine
+// of the other byte order fails the byte-order check and is rejected like
+// any stale snapshot.
+class SnapshotWriter {
+public:
+    SnapshotWriter(uint32_t kind, uint32_t version, uint64_t source_hash)
+        : kind_(kind), version_(version), source_hash_(source_hash) {}
+
+    template <typename T>
+    void add(uint32_t tag, const std::vector<T>& values) {
+        add_raw(tag, values.data(), values.size() * sizeof(T));
+    }
+    void add_raw(uint32_t tag, const void* data, size_t size);
+
+    // Write to a temporary file and rename it into place
+    bool write(const std::string& path) const;
+
+private:
+    uint32_t kind_;
+    uint32_t version_;
+    uint64_t source_hash_;
+    std::vector<uint8_t> payload_;
+};
+
+class SnapshotReader {
+public:
+    // Maps the file and validates magic, kind, version, source hash and checksum
+    SnapshotReader(const std::string& path, uint32_t kind, uint32_t version, uint64_t source_hash);
+
+    bool valid() const { return valid_; }
+
+    // Locate a section; returns false if it is missing
+    bool section(uint32_t tag, const uint8_t*& data, size_t& size) const;
+
+    template <typename T>
+    bool read(uint32_t tag, std::vector<T>& out) const {
+        const uint8_t* data;
+        size_t size;
+        if (!section(tag, data, size) || size % sizeof(T) != 0) return false;
+        out.resize(size / sizeof(T));
+        if (size > 0) std::memcpy(out.data(), data, size);
+        return true;
+    }
+
+private:
+    MappedFile file_;
+    bool valid_ = false;
+};
+
+// Four-character section / file-kind tags
+constexpr uint32_t snapshot_tag(const char (&s)[5]) {
+    return uint32_t(uint8_t(s[0])) | uint32_t(uint8_t(s[1])) << 8 |
+           uint32_t(uint8_t(s[2])) << 16 | uint32_t(uint8_t(s[3])) << 24;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "graph.h"
+#include "geo.h"
+#include <vector>
+#include <utility>
+
+
+// Static nearest-node index over graph node coordinates.
+//
+// Nodes are bucketed into a uniform grid (about two per cell) in a local
+// metric projection and stored cell by cell, so a query reads a handful of
+// adjacent cells and stops as soon as no unvisited cell can beat the current
+// best.
+class NodeIndex {
+public:
+    NodeIndex() = default;
+    explicit NodeIndex(const Graph& graph);
+
+    bool empty() const { return node_ids_.empty(); }
+
+    // Closest node index, or -1 for an empty graph
+    int nearest(double lat, double lon) const;
+
+    // Up to k closest node indices, nearest first
+    std::vector<int> k_nearest(double lat, double lon, int k) const;
+
+private:
+    LocalProjection proj_;
+    double min_x_ = 0.0;
+    double min_y_ = 0.0;
+    double cell_size_ = 1.0;
+    int nx_ = 0;
+    int ny_ = 0;
+
+    // cell c holds entries [cell_start_[c], cell_start_[c + 1])
+    std::vector<int> cell_start_;
+    std::vector<float> xs_;
+    std::vector<float> ys_;
+    std::vector<int> node_ids_;
+
+    int cell_x(double x) const;
+    int cell_y(double y) const;
+
+    // Lower bound on the distance from (x, y) to any cell outside the
+    // box [x0, x1] x [y0, y1]; negative once the box covers the whole grid
+    double outside_bound(double x, double y, int x0, int x1, int y0, int y1) const;
+};
+
+
+// Static R-tree over edge segments (one per straight piece of an edge's
+// shape), bulk loaded with Sort-Tile-Recursive packing (16 entries per
+// node). Nearest-edge lookups walk the tree best first and only open the few
+// leaves whose boxes can still beat the best distance found.
+class EdgeIndex {
+public:
+    EdgeIndex() = default;
+    explicit EdgeIndex(const Graph& graph);
+
+    bool empty() const { return slots_.empty(); }
+
+    // Distance in meters from a point to the closest edge (infinity if empty)
+    double nearest_distance(double lat, double lon) const;
+
+    // Every edge slot within radius_m of the point, once, with its distance
+    void within(double lat, double lon, double radius_m,
+                std::vector<std::pair<int, double>>& out) const;
+
+    // Every edge slot with some part inside a polygon of (lat, lon)
+    // vertices (implicitly closed), once, in ascending order
+    void in_polygon(const std::vector<std::pair<double, double>>& polygon,
+                    std::vector<int>& out) const;
+
+private:
+    struct Box {
+        float min_x, min_y, max_x, max_y;
+    };
+
+    struct TreeNode {
+        Box box;
+        int first;   // first child node, or first item for a leaf
+        int count;
+    };
+
+    static constexpr int NODE_CAPACITY = 16;
+
+    LocalProjection proj_;
+
+    // segments in tree order
+    std::vector<float> ax_, ay_, bx_, by_;
+    std::vector<int> slots_;
+
+    // leaves occupy [0, num_leaves_), the root is last
+    std::vector<TreeNode> tree_;
+    int num_leaves_ = 0;
+
+    double segment_distance2(int item, double x, double y) const;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Forward declaration
+class RoutingEngine;
+
+
+// Live travel speeds per edge, built from probe observations and fed to a
+// RoutingEngine in consolidated batches.
+//
+// Each edge slot keeps an exponentially smoothed speed in metres per second.
+// Without new observations the speed decays back to its free-flow value,
+// which comes from the edge's length and its baseline weight. observe()
+// only touches the per-slot arrays; flush() visits the slots that are away
+// from free flow and updates the engine's Traffic override layer in one
+// batch: weights that moved enough to matter are set, and edges back at
+// free flow have their override removed.
+class TrafficModel {
+public:
+    struct Options {
+        double alpha = 0.3;          // weight of a new observation in the average
+        double half_life = 600.0;    // seconds for a deviation from free flow to halve
+        double min_change = 0.05;    // relative weight change worth publishing
+        double min_speed = 0.5;      // floor for observed speeds (m/s)
+        double max_speed_ratio = 2.0;  // cap for observed speeds, times free flow
+    };
+
+    // Free-flow speeds are taken from the engine's baseline weights
+    explicit TrafficModel(RoutingEngine& engine);
+    TrafficModel(RoutingEngine& engine, const Options& options);
+    ~TrafficModel();
+
+    // Ingest observations: speeds in m/s at times in seconds (any fixed
+    // epoch, the same one flush() uses). Unknown edges are skipped; returns
+    // the number accepted. Safe alongside flush() and other observers.
+    int observe(const int* edge_ids, const double* speeds, const double* times, int count);
+
+    // Decay every tracked edge to `now` and apply the overrides that changed
+    // as one batch. Returns the number of edges updated. Concurrent flushes
+    // run one at a time, each applied before the next computes its batch.
+    int flush(double now);
+
+    // Flush every interval seconds on a background thread, with `now` taken
+    // from the system clock in Unix seconds
+    void start(double interval);
+    void stop();
+
+    // Current smoothed speed of an edge (free flow when never observed),
+    // -1 for an unknown id
+    double speed(int edge_id, double now) const;
+    double free_flow_speed(int edge_id) const;
+
+    // Unix seconds from the system clock
+    static double now();
+
+private:
+    RoutingEngine& engine_;
+    Options options_;
+
+    // Times are stored as float offsets from the first observation's time
+    double origin_ = 0.0;
+    bool has_origin_ = false;
+
+    // Per edge slot; a free speed of 0 marks an edge that cannot be tracked
+    std::vector<float> free_speed_;
+    std::vector<float> speed_;
+    std::vector<float> updated_;     // time of speed_, relative to origin_
+    std::vector<float> published_;   // override last sent, the baseline if none
+    std::vector<char> tracked_;      // in active_
+
+    std::vector<int> active_;        // slots whose speed is away from free flow
+    mutable std::mutex mutex_;
+    std::mutex flush_mutex_;         // held across computing and applying a batch
+
+    std::thread flusher_;
+    std::atomic<bool> running_{false};
+    std::mutex flusher_mutex_;
+    std::condition_variable flusher_cv_;
+
+    // Speed of a slot decayed to time t (relative to origin_)
+    double decayed(int slot, double t) const;
+    double weight_at(int slot, double speed) const;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+// Bounded multi-producer, single-consumer queue of (edge slot, weight)
+// updates.
+//
+// A ring of cells, each carrying a sequence number that says whether it is
+// free for the producer at a given position or holds an item for the
+// consumer at it. push() claims a position with one CAS and never blocks or
+// allocates; it fails when the ring is full.
+class UpdateQueue {
+public:
+    // Capacity is rounded up to a power of two
+    explicit UpdateQueue(size_t capacity = 1 << 16);
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Safe from any number of threads; false when full
+    bool push(int slot, double weight);
+
+    // Move every queued update to the end of out, oldest first; returns how
+    // many. Only one thread may drain at a time.
+    size_t drain(std::vector<std::pair<int, double>>& out);
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        int slot;
+        double weight;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> tail_{0};   // next position for producers
+    alignas(64) size_t head_ = 0;               // next position for the consumer
+};
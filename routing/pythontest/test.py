@@ -58,6 +58,88 @@ lib.update_edge_by_nodes.argtypes = [
 ]
 lib.update_edge_by_nodes.restype = None
 
+# Route path: node indices, coordinates and per-hop costs into buffers
+lib.route_path.argtypes = [
+    ctypes.c_double, ctypes.c_double,
+    ctypes.c_double, ctypes.c_double,
+    ctypes.POINTER(ctypes.c_int),
+    ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(ctypes.c_double),
+    ctypes.c_int, ctypes.POINTER(ctypes.c_double)
+]
+lib.route_path.restype = ctypes.c_int
+
+# Batched updates, applied as one step; return the number applied
+lib.update_edges_by_id.argtypes = [
+    ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_double), ctypes.c_int
+]
+lib.update_edges_by_id.restype = ctypes.c_int
+
+lib.update_edges_by_nodes.argtypes = [
+    ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int),
+    ctypes.POINTER(ctypes.c_double), ctypes.c_int
+]
+lib.update_edges_by_nodes.restype = ctypes.c_int
+
+# Non-blocking update queue, applied by flush_edge_updates
+lib.enqueue_edge_update.argtypes = [ctypes.c_int, ctypes.c_double]
+lib.enqueue_edge_update.restype = ctypes.c_bool
+
+lib.flush_edge_updates.argtypes = []
+lib.flush_edge_updates.restype = ctypes.c_int
+
+# Weight of an edge before any override, -1 if the id is unknown
+lib.edge_baseline_weight.argtypes = [ctypes.c_int]
+lib.edge_baseline_weight.restype = ctypes.c_double
+
+# Override layers; the update_edge_* calls write permanent MANUAL overrides
+LAYER_TRAFFIC, LAYER_INCIDENT, LAYER_MANUAL = 0, 1, 2
+
+# Area overrides by radius (metres) or polygon; return the number of edges
+lib.set_edge_overrides_in_radius.argtypes = [
+    ctypes.c_int, ctypes.c_double, ctypes.c_double, ctypes.c_double,
+    ctypes.c_double, ctypes.c_double
+]
+lib.set_edge_overrides_in_radius.restype = ctypes.c_int
+
+lib.scale_edge_overrides_in_radius.argtypes = [
+    ctypes.c_int, ctypes.c_double, ctypes.c_double, ctypes.c_double,
+    ctypes.c_double, ctypes.c_double
+]
+lib.scale_edge_overrides_in_radius.restype = ctypes.c_int
+
+lib.clear_edge_overrides_in_radius.argtypes = [
+    ctypes.c_int, ctypes.c_double, ctypes.c_double, ctypes.c_double
+]
+lib.clear_edge_overrides_in_radius.restype = ctypes.c_int
+
+lib.set_edge_overrides_in_polygon.argtypes = [
+    ctypes.c_int, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+    ctypes.c_int, ctypes.c_double, ctypes.c_double
+]
+lib.set_edge_overrides_in_polygon.restype = ctypes.c_int
+
+lib.scale_edge_overrides_in_polygon.argtypes = [
+    ctypes.c_int, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+    ctypes.c_int, ctypes.c_double, ctypes.c_double
+]
+lib.scale_edge_overrides_in_polygon.restype = ctypes.c_int
+
+lib.clear_edge_overrides_in_polygon.argtypes = [
+    ctypes.c_int, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+    ctypes.c_int
+]
+lib.clear_edge_overrides_in_polygon.restype = ctypes.c_int
+
+# Remove overrides by edge id, or a whole layer
+lib.clear_edge_overrides.argtypes = [
+    ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.c_int
+]
+lib.clear_edge_overrides.restype = ctypes.c_int
+
+lib.clear_override_layer.argtypes = [ctypes.c_int]
+lib.clear_override_layer.restype = ctypes.c_int
+
 # # Update edge weight
 # lib.update_edge.argtypes = [
 #     ctypes.c_double, ctypes.c_double, ctypes.c_double
@@ -143,6 +225,243 @@ def update_edge_by_nodes(frm, to, weight):
         int(frm), int(to),float(weight)
     )
 
+def set_edge_overrides_in_radius(layer, lat, lon, radius_m, weight, expires=0.0):
+    """
+    Override every edge within radius_m metres of a point; float("inf")
+    closes them. Returns the number of edges.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    return lib.set_edge_overrides_in_radius(
+        int(layer), float(lat), float(lon), float(radius_m),
+        float(weight), float(expires)
+    )
+
+def scale_edge_overrides_in_radius(layer, lat, lon, radius_m, factor, expires=0.0):
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    return lib.scale_edge_overrides_in_radius(
+        int(layer), float(lat), float(lon), float(radius_m),
+        float(factor), float(expires)
+    )
+
+def clear_edge_overrides_in_radius(layer, lat, lon, radius_m):
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    return lib.clear_edge_overrides_in_radius(
+        int(layer), float(lat), float(lon), float(radius_m)
+    )
+
+def _polygon(points):
+    n = len(points)
+    lats = (ctypes.c_double * n)(*[p[0] for p in points])
+    lons = (ctypes.c_double * n)(*[p[1] for p in points])
+    return lats, lons, n
+
+def set_edge_overrides_in_polygon(layer, points, weight, expires=0.0):
+    """
+    Override every edge with some part inside a polygon of (lat, lon)
+    vertices. Returns the number of edges.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    lats, lons, n = _polygon(points)
+    return lib.set_edge_overrides_in_polygon(
+        int(layer), lats, lons, n, float(weight), float(expires)
+    )
+
+def scale_edge_overrides_in_polygon(layer, points, factor, expires=0.0):
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    lats, lons, n = _polygon(points)
+    return lib.scale_edge_overrides_in_polygon(
+        int(layer), lats, lons, n, float(factor), float(expires)
+    )
+
+def clear_edge_overrides_in_polygon(layer, points):
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    lats, lons, n = _polygon(points)
+    return lib.clear_edge_overrides_in_polygon(int(layer), lats, lons, n)
+
+def route_path(lat1, lon1, lat2, lon2):
+    """
+    Graph node indices along the shortest path, [] if unreachable.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    capacity = 0
+    while True:
+        nodes = (ctypes.c_int * capacity)()
+        n = lib.route_path(
+            float(lat1), float(lon1), float(lat2), float(lon2),
+            nodes, None, None, None, capacity, None
+        )
+        if n < 0:
+            raise ValueError("Point could not be snapped to the road graph")
+        if n <= capacity:
+            return list(nodes[:n])
+        capacity = n
+
+def update_edges_by_id(ids, weights):
+    """
+    Update many edges by id as one atomic step; returns the number applied.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    n = len(ids)
+    return lib.update_edges_by_id(
+        (ctypes.c_int * n)(*ids), (ctypes.c_double * n)(*weights), n
+    )
+
+def update_edges_by_nodes(frm, to, weights):
+    """
+    Update many edges by (from, to) node pair as one atomic step.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    n = len(frm)
+    return lib.update_edges_by_nodes(
+        (ctypes.c_int * n)(*frm), (ctypes.c_int * n)(*to),
+        (ctypes.c_double * n)(*weights), n
+    )
+
+def enqueue_edge_update(id, weight):
+    """
+    Queue an update without applying it. When the queue is full it is
+    flushed and the update retried; False only if the id is unknown.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    if lib.enqueue_edge_update(int(id), float(weight)):
+        return True
+    if edge_baseline_weight(id) < 0:
+        return False
+    lib.flush_edge_updates()
+    return lib.enqueue_edge_update(int(id), float(weight))
+
+def flush_edge_updates():
+    """
+    Apply every queued update as one batch; returns how many.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    return lib.flush_edge_updates()
+
+def edge_baseline_weight(id):
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    return lib.edge_baseline_weight(int(id))
+
+def clear_edge_overrides(layer, ids):
+    """
+    Remove the overrides of the given edge ids in one layer.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    arr = (ctypes.c_int * len(ids))(*ids)
+    return lib.clear_edge_overrides(int(layer), arr, len(ids))
+
+def clear_override_layer(layer):
+    """
+    Remove every override of a layer; returns how many there were.
+    """
+    if not _initialized:
+        raise RuntimeError("Router not initialized. Call init() first.")
+
+    return lib.clear_override_layer(int(layer))
+
+# ============================================================
+# Tests
+# ============================================================
+
+def test_batch_updates(start_lat, start_lon, end_lat, end_lon):
+    """
+    A batch must route like the same edits applied one by one, and skip
+    unknown edges in the count it returns.
+    """
+    baseline = route_distance(start_lat, start_lon, end_lat, end_lon)
+
+    # Slow down every hop of the current route
+    path = route_path(start_lat, start_lon, end_lat, end_lon)
+    assert len(path) > 1
+    frm, to = path[:-1], path[1:]
+    slow = [1000.0] * len(frm)
+
+    for a, b, w in zip(frm, to, slow):
+        update_edge_by_nodes(a, b, w)
+    one_by_one = route_distance(start_lat, start_lon, end_lat, end_lon)
+    assert one_by_one > baseline
+    clear_override_layer(LAYER_MANUAL)
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) == baseline
+
+    n = update_edges_by_nodes(frm + [-1, path[0]], to + [-1, path[0]], slow + [1.0, 1.0])
+    assert n == len(frm), (n, len(frm))
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) == one_by_one
+    clear_override_layer(LAYER_MANUAL)
+
+    # By id, mixed with ids the graph does not have
+    ids = list(range(64)) + [-1, 2**31 - 1]
+    weights = [500.0] * len(ids)
+    known = sum(1 for i in ids if edge_baseline_weight(i) >= 0)
+    assert known > 0
+
+    for i, w in zip(ids, weights):
+        update_edge_by_id(i, w)
+    one_by_one = route_distance(start_lat, start_lon, end_lat, end_lon)
+    clear_override_layer(LAYER_MANUAL)
+
+    n = update_edges_by_id(ids, weights)
+    assert n == known, (n, known)
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) == one_by_one
+    clear_override_layer(LAYER_MANUAL)
+
+    # Queued, applied as one batch by the flush
+    queued = sum(1 for i, w in zip(ids, weights) if enqueue_edge_update(i, w))
+    assert queued == known, (queued, known)
+    assert flush_edge_updates() == known
+    assert flush_edge_updates() == 0
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) == one_by_one
+    clear_override_layer(LAYER_MANUAL)
+
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) == baseline
+    print("Batch updates: OK")
+
+def test_area_overrides(start_lat, start_lon, end_lat, end_lon, lat, lon, radius_m=50):
+    """
+    Closing or slowing an area around a point on the route must lengthen it,
+    and clearing the same area must restore the baseline exactly.
+    """
+    baseline = route_distance(start_lat, start_lon, end_lat, end_lon)
+
+    closed = set_edge_overrides_in_radius(LAYER_INCIDENT, lat, lon, radius_m, float("inf"))
+    assert closed > 0
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) > baseline
+    assert clear_edge_overrides_in_radius(LAYER_INCIDENT, lat, lon, radius_m) == closed
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) == baseline
+
+    d = radius_m / 111000.0   # metres to degrees, roughly
+    box = [(lat - d, lon - d), (lat - d, lon + d), (lat + d, lon + d), (lat + d, lon - d)]
+    scaled = scale_edge_overrides_in_polygon(LAYER_INCIDENT, box, 10.0)
+    assert scaled > 0
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) > baseline
+    assert clear_edge_overrides_in_polygon(LAYER_INCIDENT, box) == scaled
+    assert route_distance(start_lat, start_lon, end_lat, end_lon) == baseline
+    print("Area overrides: OK")
+
 # ============================================================
 # Example usage (direct test)
 # ============================================================
@@ -167,9 +486,17 @@ if __name__ == "__main__":
     dist_after = route_distance(start_lat, start_lon, end_lat, end_lon)
     print(f"Distance after update: {dist_after:.2f} meters")
 
-    # 4. Optional: update back to normal
+    # 4. Reset by removing the manual override; writing a weight back would
+    # leave a permanent override on the edge instead
     print("Resetting edge weight...")
-    update_edge_by_coordinates(accident_lat, accident_lon,1.0) 
+    assert clear_override_layer(LAYER_MANUAL) > 0
 
     dist_reset = route_distance(start_lat, start_lon, end_lat, end_lon)
     print(f"Distance after reset: {dist_reset:.2f} meters")
+    assert dist_reset == dist_before, (dist_reset, dist_before)
+
+    # 5. Batched and queued updates
+    test_batch_updates(start_lat, start_lon, end_lat, end_lon)
+
+    # 6. Closures and slowdowns over an area around the accident
+    test_area_overrides(start_lat, start_lon, end_lat, end_lon, accident_lat, accident_lon)
@@ -1,95 +1,236 @@
 #include "astar.h"
+#include "search_kernel.h"
 #include "graph.h"
-#include <queue>
 #include <limits>
 #include <cmath>
 #include <algorithm>
+#include <functional>
+#include <type_traits>
+
+void SearchContext::reset(int num_nodes) {
+    if (static_cast<int>(stamp_.size()) != num_nodes) {
+        stamp_.assign(num_nodes, 0);
+        closed_.assign(num_nodes, 0);
+        g_.resize(num_nodes);
+        parent_.resize(num_nodes);
+        generation_ = 0;
+    }
 
-struct AStarNode {
-    int index;
-    double g_cost;  // cost from start
-    double f_cost;  // g + heuristic
-    int parent;
-
-    bool operator>(const AStarNode& other) const {
-        return f_cost > other.f_cost;
+    if (++generation_ == 0) {
+        // Wrapped around: old stamps could alias the new generation
+        std::fill(stamp_.begin(), stamp_.end(), 0);
+        std::fill(closed_.begin(), closed_.end(), 0);
+        generation_ = 1;
     }
-};
+}
 
-double AStar::heuristic(const Node& a, const Node& b) {
-    const double R = 6371000.0; // Earth radius in meters
-    double lat1 = a.lat * M_PI / 180.0;
-    double lon1 = a.lon * M_PI / 180.0;
-    double lat2 = b.lat * M_PI / 180.0;
-    double lon2 = b.lon * M_PI / 180.0;
+SearchContext& SearchContext::local(int slot) {
+    thread_local SearchContext ctx[2];
+    return ctx[slot];
+}
 
-    double dlat = lat2 - lat1;
-    double dlon = lon2 - lon1;
+namespace {
+
+// Call f with the context's queue policy; the switch runs once per search,
+// outside the loop f instantiates
+template <typename F>
+decltype(auto) with_queue(SearchContext& ctx, F&& f) {
+    switch (ctx.queue_kind()) {
+        case QueueKind::Quaternary:
+            return f(ctx.open<QuaternaryHeap>());
+        case QueueKind::Radix:
+            return f(ctx.open<RadixHeap>());
+        case QueueKind::Binary:
+        default:
+            return f(ctx.open<BinaryHeap>());
+    }
+}
 
-    double h = std::sin(dlat/2) * std::sin(dlat/2) +
-               std::cos(lat1)*std::cos(lat2)*std::sin(dlon/2)*std::sin(dlon/2);
-    return 2 * R * std::atan2(std::sqrt(h), std::sqrt(1-h));
+// Run one SearchKernel instantiation from origin with the context's queue
+template <typename Edges, typename Heuristic, typename Stop, typename Weights>
+void run(const Graph& graph, const Weights& weights, int origin, SearchContext& ctx,
+         const Heuristic& heuristic, Stop& stop) {
+    with_queue(ctx, [&](auto& open) {
+        SearchKernel<Edges, Heuristic, Stop>::run(graph, weights, origin, ctx, open,
+                                                  heuristic, stop);
+    });
 }
 
+// Node path from the search origin to goal as left in ctx
+AStarResult path_to(const SearchContext& ctx, int goal) {
+    AStarResult result;
+    result.total_cost = ctx.g(goal);
+    if (result.total_cost == std::numeric_limits<double>::infinity()) {
+        // No path
+        return result;
+    }
 
+    for (int curr = goal; curr != -1; curr = ctx.parent(curr)) {
+        result.path.push_back(curr);
+    }
+    std::reverse(result.path.begin(), result.path.end());
+    return result;
+}
 
+}
 
 AStarResult AStar::shortest_path(const Graph& graph, int start_idx, int goal_idx) {
-    const auto& nodes = graph.nodes();
-    int N = nodes.size();
-
-    std::vector<double> g(N, std::numeric_limits<double>::infinity());
-    std::vector<int> parent(N, -1);
-    std::vector<bool> closed(N, false);
-
-    using PQElement = AStarNode;
-    std::priority_queue<PQElement, std::vector<PQElement>, std::greater<PQElement>> open;
-
-    g[start_idx] = 0.0;
-    open.push({start_idx, 0.0,
-               heuristic(nodes[start_idx], nodes[goal_idx]), -1});
-
-    while (!open.empty()) {
-        auto current = open.top();
-        open.pop();
-
-        if (closed[current.index]) continue;
-        closed[current.index] = true;
-
-        if (current.index == goal_idx) break;
-
-        for (const auto& edge : nodes[current.index].edges) {
-            int neighbor = edge->to;
-            if (closed[neighbor]) continue;
-
-            double tentative_g = g[current.index] + edge->weight;
-            if (tentative_g < g[neighbor]) {
-                g[neighbor] = tentative_g;
-                parent[neighbor] = current.index;
-                double f = tentative_g +
-                           heuristic(nodes[neighbor], nodes[goal_idx]);
-                open.push({neighbor, tentative_g, f, current.index});
-            }
-        }
+    return shortest_path(graph, start_idx, goal_idx, SearchContext::local());
+}
+
+AStarResult AStar::shortest_path(const Graph& graph, int start_idx, int goal_idx,
+                                 SearchContext& ctx) {
+    return shortest_path(graph, start_idx, goal_idx, graph.weights(), ctx);
+}
+
+AStarResult AStar::shortest_path(const Graph& graph, int start_idx, int goal_idx,
+                                 const EdgeWeights::Snapshot& weights, SearchContext& ctx) {
+    GeoHeuristic heuristic{graph, graph.node(goal_idx), weights.max_speed()};
+    StopAtGoal stop{goal_idx};
+    run<OutEdges>(graph, weights, start_idx, ctx, heuristic, stop);
+    return path_to(ctx, goal_idx);
+}
+
+AStarResult AStar::alt(const Graph& graph, const Landmarks& landmarks,
+                       int start_idx, int goal_idx) {
+    return alt(graph, landmarks, start_idx, goal_idx, SearchContext::local());
+}
+
+AStarResult AStar::alt(const Graph& graph, const Landmarks& landmarks,
+                       int start_idx, int goal_idx, SearchContext& ctx) {
+    EdgeWeights::Snapshot weights = graph.weights();
+    LandmarkHeuristic heuristic{landmarks, goal_idx};
+    StopAtGoal stop{goal_idx};
+    run<OutEdges>(graph, weights, start_idx, ctx, heuristic, stop);
+    return path_to(ctx, goal_idx);
+}
+
+AStarResult AStar::bounded(const Graph& graph, int start_idx, int goal_idx,
+                           double max_cost, const Landmarks* landmarks) {
+    return bounded(graph, start_idx, goal_idx, max_cost, landmarks, SearchContext::local());
+}
+
+AStarResult AStar::bounded(const Graph& graph, int start_idx, int goal_idx,
+                           double max_cost, const Landmarks* landmarks,
+                           SearchContext& ctx) {
+    return bounded(graph, start_idx, goal_idx, max_cost, landmarks, graph.weights(), ctx);
+}
+
+AStarResult AStar::bounded(const Graph& graph, int start_idx, int goal_idx,
+                           double max_cost, const Landmarks* landmarks,
+                           const EdgeWeights::Snapshot& weights, SearchContext& ctx) {
+    StopAtGoalWithin stop{goal_idx, max_cost};
+    if (landmarks && !landmarks->empty()) {
+        LandmarkHeuristic heuristic{*landmarks, goal_idx};
+        run<OutEdges>(graph, weights, start_idx, ctx, heuristic, stop);
+    } else {
+        GeoHeuristic heuristic{graph, graph.node(goal_idx), weights.max_speed()};
+        run<OutEdges>(graph, weights, start_idx, ctx, heuristic, stop);
     }
+    return path_to(ctx, goal_idx);
+}
 
-    AStarResult result;
+AStarResult AStar::dijkstra(const Graph& graph, int start_idx, int goal_idx) {
+    return dijkstra(graph, start_idx, goal_idx, SearchContext::local());
+}
+
+AStarResult AStar::dijkstra(const Graph& graph, int start_idx, int goal_idx,
+                            SearchContext& ctx) {
+    return dijkstra(graph, start_idx, goal_idx, graph.weights(), ctx);
+}
+
+AStarResult AStar::dijkstra(const Graph& graph, int start_idx, int goal_idx,
+                            const EdgeWeights::Snapshot& weights, SearchContext& ctx) {
+    StopAtGoal stop{goal_idx};
+    run<OutEdges>(graph, weights, start_idx, ctx, ZeroHeuristic(), stop);
+    return path_to(ctx, goal_idx);
+}
+
+void AStar::one_to_many(const Graph& graph, int start_idx,
+                        const std::vector<int>& goals, double* out) {
+    one_to_many(graph, start_idx, goals, out, SearchContext::local());
+}
+
+void AStar::one_to_many(const Graph& graph, int start_idx,
+                        const std::vector<int>& goals, double* out,
+                        SearchContext& ctx) {
+    std::vector<int> pending(goals);
+    std::sort(pending.begin(), pending.end());
+    pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+    EdgeWeights::Snapshot weights = graph.weights();
+    StopAtTargets stop{pending, pending.size()};
+    if (!pending.empty()) {
+        run<OutEdges>(graph, weights, start_idx, ctx, ZeroHeuristic(), stop);
+    } else {
+        ctx.reset(graph.num_nodes());
+    }
+
+    for (size_t j = 0; j < goals.size(); ++j) {
+        out[j] = ctx.closed(goals[j]) ? ctx.g(goals[j])
+                                      : std::numeric_limits<double>::infinity();
+    }
+}
+
+void AStar::reverse_dijkstra(const Graph& graph, int goal_idx,
+                             const std::function<bool(int, double)>& visit) {
+    reverse_dijkstra(graph, goal_idx, visit, SearchContext::local());
+}
+
+void AStar::reverse_dijkstra(const Graph& graph, int goal_idx,
+                             const std::function<bool(int, double)>& visit,
+                             SearchContext& ctx) {
+    EdgeWeights::Snapshot weights = graph.weights();
+    VisitUntil<const std::function<bool(int, double)>> stop{visit};
+    run<InEdges>(graph, weights, goal_idx, ctx, ZeroHeuristic(), stop);
+}
+
+void AStar::forward_dijkstra(const Graph& graph, int start_idx,
+                             const std::function<bool(int, double)>& visit) {
+    forward_dijkstra(graph, start_idx, visit, SearchContext::local());
+}
+
+void AStar::forward_dijkstra(const Graph& graph, int start_idx,
+                             const std::function<bool(int, double)>& visit,
+                             SearchContext& ctx) {
+    EdgeWeights::Snapshot weights = graph.weights();
+    VisitUntil<const std::function<bool(int, double)>> stop{visit};
+    run<OutEdges>(graph, weights, start_idx, ctx, ZeroHeuristic(), stop);
+}
 
-    if (g[goal_idx] == std::numeric_limits<double>::infinity()) {
+AStarResult AStar::bidirectional(const Graph& graph, int start_idx, int goal_idx) {
+    return bidirectional(graph, start_idx, goal_idx,
+                         SearchContext::local(0), SearchContext::local(1));
+}
+
+AStarResult AStar::bidirectional(const Graph& graph, int start_idx, int goal_idx,
+                                 SearchContext& forward, SearchContext& backward) {
+    return bidirectional(graph, start_idx, goal_idx, graph.weights(), forward, backward);
+}
+
+AStarResult AStar::bidirectional(const Graph& graph, int start_idx, int goal_idx,
+                                 const EdgeWeights::Snapshot& weights,
+                                 SearchContext& forward, SearchContext& backward) {
+    // Both sides use the forward context's queue policy
+    AStarResult result;
+    int meet = with_queue(forward, [&](auto& fq) {
+        auto& bq = backward.open<std::decay_t<decltype(fq)>>();
+        return bidirectional_search(graph, weights, start_idx, goal_idx,
+                                    forward, fq, backward, bq, result.total_cost);
+    });
+    if (meet < 0) {
         // No path
-        result.total_cost = std::numeric_limits<double>::infinity();
         return result;
     }
 
-    // Reconstruct path
-    int curr = goal_idx;
-    while (curr != -1) {
+    // Forward half (start .. meet), then backward half (meet .. goal)
+    for (int curr = meet; curr != -1; curr = forward.parent(curr)) {
         result.path.push_back(curr);
-        curr = parent[curr];
     }
     std::reverse(result.path.begin(), result.path.end());
+    for (int curr = backward.parent(meet); curr != -1; curr = backward.parent(curr)) {
+        result.path.push_back(curr);
+    }
 
-    result.total_cost = g[goal_idx];
     return result;
 }
-
@@ -0,0 +1,541 @@
+#include "cch.h"
+#include "geo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+namespace {
+
+const double INF = std::numeric_limits<double>::infinity();
+
+// Cells at or below this size are ordered directly instead of bisected
+constexpr int DISSECTION_LEAF_SIZE = 16;
+
+// Levels with fewer arcs than this are customized on the calling thread
+constexpr int PARALLEL_GRAIN = 4096;
+
+constexpr int NO_ARC = std::numeric_limits<int>::min();
+
+}
+
+template <typename F>
+void CustomizableCH::parallel_for(int n, F&& fn) const {
+    int threads = std::min(num_threads_, n / PARALLEL_GRAIN + 1);
+    if (threads <= 1) {
+        for (int i = 0; i < n; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<int> next{0};
+    auto worker = [&]() {
+        constexpr int CHUNK = 256;
+        for (int begin = next.fetch_add(CHUNK); begin < n; begin = next.fetch_add(CHUNK)) {
+            int end = std::min(begin + CHUNK, n);
+            for (int i = begin; i < end; ++i) fn(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
+
+CustomizableCH::CustomizableCH(const Graph& graph, int num_threads) {
+    if (graph.num_nodes() == 0) return;
+
+    num_threads_ = num_threads > 0 ? num_threads
+                                   : std::max(1u, std::thread::hardware_concurrency());
+
+    compute_order(graph);
+    build_upward_graph(graph);
+
+    // Full customization, level by level from the bottom of the elimination tree
+    for (size_t L = 0; L + 1 < level_offsets_.size(); ++L) {
+        int begin = level_offsets_[L];
+        int count = level_offsets_[L + 1] - begin;
+        parallel_for(count, [&](int i) { customize_arc(level_arcs_[begin + i]); });
+    }
+}
+
+void CustomizableCH::compute_order(const Graph& graph) {
+    int N = graph.num_nodes();
+
+    // Undirected adjacency
+    std::vector<int> adj_offsets(N + 1, 0);
+    std::vector<int> adj;
+    for (int v = 0; v < N; ++v) {
+        size_t start = adj.size();
+        for (int e = graph.edge_begin(v); e < graph.edge_end(v); ++e) {
+            adj.push_back(graph.edge_target(e));
+        }
+        for (int i = graph.in_begin(v); i < graph.in_end(v); ++i) {
+            adj.push_back(graph.edge_source(graph.in_slot(i)));
+        }
+        std::sort(adj.begin() + start, adj.end());
+        adj.erase(std::unique(adj.begin() + start, adj.end()), adj.end());
+        adj.erase(std::remove(adj.begin() + start, adj.end(), v), adj.end());
+        adj_offsets[v + 1] = static_cast<int>(adj.size());
+    }
+
+    LocalProjection proj(graph.get_node_lat(0), graph.get_node_lon(0));
+    std::vector<double> xs(N), ys(N);
+    for (int v = 0; v < N; ++v) {
+        xs[v] = proj.x(graph.get_node_lon(v));
+        ys[v] = proj.y(graph.get_node_lat(v));
+    }
+
+    // Ranks are handed out from the top: each cell's separator ranks above
+    // everything inside the two halves it separates
+    rank_.assign(N, -1);
+    int next_rank = N - 1;
+
+    std::vector<int> mark(N, 0);
+    int tag = 0;
+
+    std::vector<std::vector<int>> cells;
+    cells.emplace_back(N);
+    for (int v = 0; v < N; ++v) cells.back()[v] = v;
+
+    while (!cells.empty()) {
+        std::vector<int> cell = std::move(cells.back());
+        cells.pop_back();
+
+        if (static_cast<int>(cell.size()) <= DISSECTION_LEAF_SIZE) {
+            // Higher degree nodes go above lower degree ones
+            std::sort(cell.begin(), cell.end(), [&](int a, int b) {
+                return adj_offsets[a + 1] - adj_offsets[a] > adj_offsets[b + 1] - adj_offsets[b];
+            });
+            for (int v : cell) rank_[v] = next_rank--;
+            continue;
+        }
+
+        // Split at the median of the wider extent
+        double min_x = INF, max_x = -INF, min_y = INF, max_y = -INF;
+        for (int v : cell) {
+            min_x = std::min(min_x, xs[v]); max_x = std::max(max_x, xs[v]);
+            min_y = std::min(min_y, ys[v]); max_y = std::max(max_y, ys[v]);
+        }
+        const std::vector<double>& key = (max_x - min_x >= max_y - min_y) ? xs : ys;
+
+        size_t half = cell.size() / 2;
+        std::nth_element(cell.begin(), cell.begin() + half, cell.end(),
+                         [&](int a, int b) { return key[a] < key[b]; });
+
+        int side_a = ++tag;
+        int side_b = ++tag;
+        for (size_t i = 0; i < cell.size(); ++i) {
+            mark[cell[i]] = i < half ? side_a : side_b;
+        }
+
+        // Boundary nodes of each half; the smaller boundary is the separator
+        std::vector<int> boundary_a, boundary_b;
+        for (int v : cell) {
+            int other = mark[v] == side_a ? side_b : side_a;
+            for (int i = adj_offsets[v]; i < adj_offsets[v + 1]; ++i) {
+                if (mark[adj[i]] == other) {
+                    (mark[v] == side_a ? boundary_a : boundary_b).push_back(v);
+                    break;
+                }
+            }
+        }
+        const std::vector<int>& separator =
+            boundary_a.size() <= boundary_b.size() ? boundary_a : boundary_b;
+
+        int removed = ++tag;
+        for (int v : separator) {
+            rank_[v] = next_rank--;
+            mark[v] = removed;
+        }
+
+        std::vector<int> part_a, part_b;
+        for (int v : cell) {
+            if (mark[v] == side_a) part_a.push_back(v);
+            else if (mark[v] == side_b) part_b.push_back(v);
+        }
+        if (!part_a.empty()) cells.push_back(std::move(part_a));
+        if (!part_b.empty()) cells.push_back(std::move(part_b));
+    }
+
+    node_.assign(N, -1);
+    for (int v = 0; v < N; ++v) node_[rank_[v]] = v;
+}
+
+void CustomizableCH::build_upward_graph(const Graph& graph) {
+    int N = graph.num_nodes();
+
+    // Upper neighbours by rank
+    std::vector<std::vector<int>> upper(N);
+    for (int slot = 0; slot < graph.num_edges(); ++slot) {
+        int a = rank_[graph.edge_source(slot)];
+        int b = rank_[graph.edge_target(slot)];
+        if (a == b) continue;
+        upper[std::min(a, b)].push_back(std::max(a, b));
+    }
+    for (auto& list : upper) {
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+    }
+
+    // Symbolic contraction: a node's upper neighbours form a clique, which
+    // is recorded by merging them into its elimination-tree parent
+    etree_parent_.assign(N, -1);
+    std::vector<int> merged;
+    for (int r = 0; r < N; ++r) {
+        if (upper[r].empty()) continue;
+
+        int parent = upper[r].front();
+        etree_parent_[r] = parent;
+
+        merged.clear();
+        std::set_union(upper[parent].begin(), upper[parent].end(),
+                       upper[r].begin() + 1, upper[r].end(),
+                       std::back_inserter(merged));
+        upper[parent].swap(merged);
+    }
+
+    up_offsets_.assign(N + 1, 0);
+    for (int r = 0; r < N; ++r) {
+        up_offsets_[r + 1] = up_offsets_[r] + static_cast<int>(upper[r].size());
+    }
+    int A = up_offsets_[N];
+    arc_head_.resize(A);
+    arc_tail_.resize(A);
+    for (int r = 0; r < N; ++r) {
+        std::copy(upper[r].begin(), upper[r].end(), arc_head_.begin() + up_offsets_[r]);
+        std::fill(arc_tail_.begin() + up_offsets_[r], arc_tail_.begin() + up_offsets_[r + 1], r);
+        std::vector<int>().swap(upper[r]);
+    }
+
+    // Lower neighbours; arcs are visited by increasing tail, so lists come out sorted
+    down_offsets_.assign(N + 1, 0);
+    for (int a = 0; a < A; ++a) down_offsets_[arc_head_[a] + 1]++;
+    for (int r = 0; r < N; ++r) down_offsets_[r + 1] += down_offsets_[r];
+    down_tail_.resize(A);
+    down_arc_.resize(A);
+    std::vector<int> cursor(down_offsets_.begin(), down_offsets_.end() - 1);
+    for (int a = 0; a < A; ++a) {
+        int at = cursor[arc_head_[a]]++;
+        down_tail_[at] = arc_tail_[a];
+        down_arc_[at] = a;
+    }
+
+    // Level = height above the lowest descendant
+    level_.assign(N, 0);
+    int max_level = 0;
+    for (int r = 0; r < N; ++r) {
+        for (int i = down_offsets_[r]; i < down_offsets_[r + 1]; ++i) {
+            level_[r] = std::max(level_[r], level_[down_tail_[i]] + 1);
+        }
+        max_level = std::max(max_level, level_[r]);
+    }
+
+    level_offsets_.assign(max_level + 2, 0);
+    for (int a = 0; a < A; ++a) level_offsets_[level_[arc_tail_[a]] + 1]++;
+    for (int L = 0; L <= max_level; ++L) level_offsets_[L + 1] += level_offsets_[L];
+    level_arcs_.resize(A);
+    cursor.assign(level_offsets_.begin(), level_offsets_.end() - 1);
+    for (int a = 0; a < A; ++a) level_arcs_[cursor[level_[arc_tail_[a]]]++] = a;
+
+    // Original edges seed the metric
+    up_weight_.assign(A, INF);
+    down_weight_.assign(A, INF);
+    up_base_.assign(A, INF);
+    down_base_.assign(A, INF);
+    slot_arc_.assign(graph.num_edges(), NO_ARC);
+    EdgeWeights::Snapshot weights = graph.weights();
+    for (int slot = 0; slot < graph.num_edges(); ++slot) {
+        int a = rank_[graph.edge_source(slot)];
+        int b = rank_[graph.edge_target(slot)];
+        if (a == b) continue;
+
+        int arc = find_arc(a, b);
+        slot_arc_[slot] = a < b ? arc : -(arc + 1);
+        set_base_weights(graph, weights, slot);
+    }
+}
+
+void CustomizableCH::set_base_weights(const Graph& graph,
+                                      const EdgeWeights::Snapshot& weights, int slot) {
+    int code = slot_arc_[slot];
+    if (code == NO_ARC) return;
+
+    // Cheapest of any parallel edges between the same endpoints
+    int from = graph.edge_source(slot), to = graph.edge_target(slot);
+    double base = INF;
+    for (int e = graph.edge_begin(from); e < graph.edge_end(from); ++e) {
+        if (graph.edge_target(e) == to) base = std::min(base, weights[e]);
+    }
+
+    if (code >= 0) up_base_[code] = base;
+    else down_base_[-code - 1] = base;
+}
+
+int CustomizableCH::find_arc(int a, int b) const {
+    int lo = std::min(a, b), hi = std::max(a, b);
+    auto first = arc_head_.begin() + up_offsets_[lo];
+    auto last  = arc_head_.begin() + up_offsets_[lo + 1];
+    auto it = std::lower_bound(first, last, hi);
+    return (it != last && *it == hi) ? static_cast<int>(it - arc_head_.begin()) : -1;
+}
+
+bool CustomizableCH::customize_arc(int arc) {
+    int u = arc_tail_[arc], v = arc_head_[arc];
+    double up = up_base_[arc];
+    double down = down_base_[arc];
+
+    // Lower triangles {x, u, v}: common lower neighbours of both endpoints
+    int i = down_offsets_[u], i_end = down_offsets_[u + 1];
+    int j = down_offsets_[v], j_end = down_offsets_[v + 1];
+    while (i < i_end && j < j_end) {
+        if (down_tail_[i] < down_tail_[j]) { ++i; continue; }
+        if (down_tail_[i] > down_tail_[j]) { ++j; continue; }
+
+        int xu = down_arc_[i], xv = down_arc_[j];
+        up = std::min(up, down_weight_[xu] + up_weight_[xv]);      // u -> x -> v
+        down = std::min(down, down_weight_[xv] + up_weight_[xu]);  // v -> x -> u
+        ++i;
+        ++j;
+    }
+
+    bool changed = up != up_weight_[arc] || down != down_weight_[arc];
+    up_weight_[arc] = up;
+    down_weight_[arc] = down;
+    return changed;
+}
+
+int CustomizableCH::customize(const Graph& graph, const std::vector<int>& changed_slots) {
+    if (empty()) return 0;
+
+    int levels = static_cast<int>(level_offsets_.size()) - 1;
+    std::vector<std::vector<int>> pending(levels);
+    std::vector<char> queued(num_arcs(), 0);
+
+    auto enqueue = [&](int arc) {
+        if (arc < 0 || queued[arc]) return;
+        queued[arc] = 1;
+        pending[level_[arc_tail_[arc]]].push_back(arc);
+    };
+
+    EdgeWeights::Snapshot weights = graph.weights();
+    for (int slot : changed_slots) {
+        if (slot < 0 || slot >= static_cast<int>(slot_arc_.size())) continue;
+        int code = slot_arc_[slot];
+        if (code == NO_ARC) continue;
+
+        set_base_weights(graph, weights, slot);
+        enqueue(code >= 0 ? code : -code - 1);
+    }
+
+    // Recompute level by level; an arc that changed invalidates the arcs
+    // whose lower triangles it belongs to, which all sit on higher levels
+    int recomputed = 0;
+    std::vector<char> changed;
+    for (int L = 0; L < levels; ++L) {
+        std::vector<int>& arcs = pending[L];
+        if (arcs.empty()) continue;
+
+        changed.assign(arcs.size(), 0);
+        parallel_for(static_cast<int>(arcs.size()),
+                     [&](int i) { changed[i] = customize_arc(arcs[i]); });
+        recomputed += static_cast<int>(arcs.size());
+
+        for (size_t i = 0; i < arcs.size(); ++i) {
+            if (!changed[i]) continue;
+            int x = arc_tail_[arcs[i]], y = arc_head_[arcs[i]];
+            for (int a = up_offsets_[x]; a < up_offsets_[x + 1]; ++a) {
+                if (arc_head_[a] != y) enqueue(find_arc(y, arc_head_[a]));
+            }
+        }
+    }
+    return recomputed;
+}
+
+AStarResult CustomizableCH::shortest_path(int start_idx, int goal_idx) const {
+    return shortest_path(start_idx, goal_idx,
+                         SearchContext::local(0), SearchContext::local(1));
+}
+
+AStarResult CustomizableCH::shortest_path(int start_idx, int goal_idx,
+                                          SearchContext& forward,
+                                          SearchContext& backward) const {
+    int N = static_cast<int>(rank_.size());
+    forward.reset(N);
+    backward.reset(N);
+
+    int s = rank_[start_idx], t = rank_[goal_idx];
+    forward.reach(s, 0.0, -1);
+    backward.reach(t, 0.0, -1);
+
+    double best = INF;
+    int meet = -1;
+
+    auto relax_forward = [&](int r) {
+        double g = forward.g(r);
+        if (g >= best) return;
+        for (int a = up_offsets_[r]; a < up_offsets_[r + 1]; ++a) {
+            double nd = g + up_weight_[a];
+            if (nd < forward.g(arc_head_[a])) forward.reach(arc_head_[a], nd, r);
+        }
+    };
+    auto relax_backward = [&](int r) {
+        double g = backward.g(r);
+        if (g >= best) return;
+        for (int a = up_offsets_[r]; a < up_offsets_[r + 1]; ++a) {
+            double nd = g + down_weight_[a];
+            if (nd < backward.g(arc_head_[a])) backward.reach(arc_head_[a], nd, r);
+        }
+    };
+
+    // Everything reachable upward lies on the elimination-tree path to the
+    // root, so both searches just walk their ancestor chains in rank order
+    int x = s, y = t;
+    while (x != y) {
+        if (y == -1 || (x != -1 && x < y)) {
+            relax_forward(x);
+            x = etree_parent_[x];
+        } else {
+            relax_backward(y);
+            y = etree_parent_[y];
+        }
+    }
+    for (int r = x; r != -1; r = etree_parent_[r]) {
+        double through = forward.g(r) + backward.g(r);
+        if (through < best) {
+            best = through;
+            meet = r;
+        }
+        relax_forward(r);
+        relax_backward(r);
+    }
+
+    AStarResult result;
+    result.total_cost = best;
+    if (meet < 0) {
+        // No path
+        return result;
+    }
+
+    std::vector<int> chain;
+    for (int r = meet; r != -1; r = forward.parent(r)) {
+        chain.push_back(r);
+    }
+    std::reverse(chain.begin(), chain.end());
+
+    result.path.push_back(start_idx);
+    for (size_t i = 1; i < chain.size(); ++i) {
+        unpack(chain[i - 1], chain[i], result.path);
+    }
+    for (int r = meet, next = backward.parent(meet); next != -1;
+         r = next, next = backward.parent(next)) {
+        unpack(r, next, result.path);
+    }
+
+    return result;
+}
+
+void CustomizableCH::unpack(int a, int b, std::vector<int>& path) const {
+    std::vector<std::pair<int, int>> stack{{a, b}};
+
+    while (!stack.empty()) {
+        auto [from, to] = stack.back();
+        stack.pop_back();
+
+        int arc = find_arc(from, to);
+        bool upward = from < to;
+        double weight = upward ? up_weight_[arc] : down_weight_[arc];
+        double base = upward ? up_base_[arc] : down_base_[arc];
+
+        // Either the original edge, or a detour through a lower triangle
+        int middle = -1;
+        if (weight != base) {
+            int lo = arc_tail_[arc], hi = arc_head_[arc];
+            int i = down_offsets_[lo], i_end = down_offsets_[lo + 1];
+            int j = down_offsets_[hi], j_end = down_offsets_[hi + 1];
+            while (i < i_end && j < j_end && middle < 0) {
+                if (down_tail_[i] < down_tail_[j]) { ++i; continue; }
+                if (down_tail_[i] > down_tail_[j]) { ++j; continue; }
+
+                // from -> x is a downward move, x -> to an upward one
+                int x_from = from == lo ? down_arc_[i] : down_arc_[j];
+                int x_to   = from == lo ? down_arc_[j] : down_arc_[i];
+                if (down_weight_[x_from] + up_weight_[x_to] == weight) {
+                    middle = down_tail_[i];
+                }
+                ++i;
+                ++j;
+            }
+        }
+
+        if (middle < 0) {
+            path.push_back(node_[to]);
+            continue;
+        }
+        stack.push_back({middle, to});
+        stack.push_back({from, middle});
+    }
+}
+
+void CustomizableCH::upward_walk(int r, bool backward, SearchContext& ctx) const {
+    const std::vector<double>& weight = backward ? down_weight_ : up_weight_;
+
+    ctx.reset(static_cast<int>(rank_.size()));
+    ctx.reach(r, 0.0, -1);
+    for (; r != -1; r = etree_parent_[r]) {
+        double g = ctx.g(r);
+        if (g == INF) continue;
+        for (int a = up_offsets_[r]; a < up_offsets_[r + 1]; ++a) {
+            double nd = g + weight[a];
+            if (nd < ctx.g(arc_head_[a])) ctx.reach(arc_head_[a], nd, r);
+        }
+    }
+}
+
+void CustomizableCH::many_to_many(const std::vector<int>& sources,
+                                  const std::vector<int>& targets,
+                                  double* out) const {
+    size_t S = sources.size(), T = targets.size();
+    std::fill(out, out + S * T, INF);
+    if (empty() || S == 0 || T == 0) return;
+
+    SearchContext& ctx = SearchContext::local(0);
+    int N = static_cast<int>(rank_.size());
+
+    // Buckets: for each rank, the targets whose backward search reached it
+    struct BucketEntry {
+        int target;
+        double dist;
+    };
+    std::vector<std::pair<int, BucketEntry>> entries;
+    for (size_t j = 0; j < T; ++j) {
+        int t = rank_[targets[j]];
+        upward_walk(t, true, ctx);
+        for (int r = t; r != -1; r = etree_parent_[r]) {
+            if (ctx.reached(r)) entries.push_back({r, {static_cast<int>(j), ctx.g(r)}});
+        }
+    }
+
+    std::vector<int> bucket_offsets(N + 1, 0);
+    for (const auto& e : entries) bucket_offsets[e.first + 1]++;
+    for (int r = 0; r < N; ++r) bucket_offsets[r + 1] += bucket_offsets[r];
+    std::vector<BucketEntry> buckets(entries.size());
+    std::vector<int> cursor(bucket_offsets.begin(), bucket_offsets.end() - 1);
+    for (const auto& e : entries) buckets[cursor[e.first]++] = e.second;
+
+    for (size_t i = 0; i < S; ++i) {
+        int s = rank_[sources[i]];
+        upward_walk(s, false, ctx);
+
+        double* row = out + i * T;
+        for (int r = s; r != -1; r = etree_parent_[r]) {
+            if (!ctx.reached(r)) continue;
+            double g = ctx.g(r);
+            for (int b = bucket_offsets[r]; b < bucket_offsets[r + 1]; ++b) {
+                double through = g + buckets[b].dist;
+                if (through < row[buckets[b].target]) row[buckets[b].target] = through;
+            }
+        }
+    }
+}
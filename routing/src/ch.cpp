@@ -0,0 +1,455 @@
+#include "ch.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace {
+
+constexpr uint32_t CH_KIND = snapshot_tag("CHIE");
+constexpr uint32_t CH_VERSION = 1;
+
+constexpr uint32_t TAG_RANK        = snapshot_tag("RANK");
+constexpr uint32_t TAG_UP_OFFSETS  = snapshot_tag("UOFF");
+constexpr uint32_t TAG_UP_TO       = snapshot_tag("UDST");
+constexpr uint32_t TAG_UP_WEIGHT   = snapshot_tag("UWGT");
+constexpr uint32_t TAG_UP_MIDDLE   = snapshot_tag("UMID");
+constexpr uint32_t TAG_DN_OFFSETS  = snapshot_tag("DOFF");
+constexpr uint32_t TAG_DN_TO       = snapshot_tag("DDST");
+constexpr uint32_t TAG_DN_WEIGHT   = snapshot_tag("DWGT");
+constexpr uint32_t TAG_DN_MIDDLE   = snapshot_tag("DMID");
+
+// Witness searches give up after settling this many nodes; a missed
+// witness only costs an unnecessary shortcut, never a wrong answer
+constexpr int WITNESS_SETTLE_LIMIT = 100;
+
+const double INF = std::numeric_limits<double>::infinity();
+
+struct Arc {
+    int to;
+    double weight;
+    int middle;
+};
+
+struct Shortcut {
+    int from;
+    int to;
+    double weight;
+};
+
+// Mutable remainder graph used while contracting
+class Contractor {
+public:
+    explicit Contractor(const Graph& graph)
+        : N_(graph.num_nodes()), out_(N_), in_(N_),
+          contracted_(N_, 0), deleted_neighbors_(N_, 0), level_(N_, 0),
+          dist_(N_, INF), stamp_(N_, 0) {
+        EdgeWeights::Snapshot weights = graph.weights();
+        for (int slot = 0; slot < graph.num_edges(); ++slot) {
+            int u = graph.edge_source(slot), v = graph.edge_target(slot);
+            if (u != v) add_arc(u, v, weights[slot], -1);
+        }
+    }
+
+    int priority(int v) {
+        shortcuts_.clear();
+        find_shortcuts(v, shortcuts_);
+
+        int removed = static_cast<int>(out_[v].size() + in_[v].size());
+        return 2 * (static_cast<int>(shortcuts_.size()) - removed) +
+               deleted_neighbors_[v] + level_[v];
+    }
+
+    // Remove v from the remainder, returning its arcs to higher-ranked nodes
+    // and the neighbours whose priority may have changed
+    void contract(int v, std::vector<Arc>& up, std::vector<Arc>& down,
+                  std::vector<int>& neighbors) {
+        up = out_[v];
+        down = in_[v];
+
+        shortcuts_.clear();
+        find_shortcuts(v, shortcuts_);
+        for (const Shortcut& s : shortcuts_) {
+            add_arc(s.from, s.to, s.weight, v);
+        }
+
+        contracted_[v] = 1;
+        neighbors.clear();
+        for (const Arc& a : out_[v]) {
+            erase_arcs_to(in_[a.to], v);
+            neighbors.push_back(a.to);
+        }
+        for (const Arc& a : in_[v]) {
+            erase_arcs_to(out_[a.to], v);
+            neighbors.push_back(a.to);
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        for (int n : neighbors) {
+            deleted_neighbors_[n]++;
+            level_[n] = std::max(level_[n], level_[v] + 1);
+        }
+
+        out_[v].clear();
+        out_[v].shrink_to_fit();
+        in_[v].clear();
+        in_[v].shrink_to_fit();
+    }
+
+private:
+    int N_;
+    std::vector<std::vector<Arc>> out_;
+    std::vector<std::vector<Arc>> in_;      // in_[v] holds {source, weight, middle}
+    std::vector<char> contracted_;
+    std::vector<int> deleted_neighbors_;
+    std::vector<int> level_;                // hierarchy depth below each node
+    std::vector<Shortcut> shortcuts_;
+
+    // witness search state
+    std::vector<double> dist_;
+    std::vector<uint32_t> stamp_;
+    uint32_t generation_ = 0;
+
+    static void erase_arcs_to(std::vector<Arc>& arcs, int v) {
+        arcs.erase(std::remove_if(arcs.begin(), arcs.end(),
+                                  [v](const Arc& a) { return a.to == v; }),
+                   arcs.end());
+    }
+
+    void add_arc(int from, int to, double weight, int middle) {
+        for (Arc& a : out_[from]) {
+            if (a.to != to) continue;
+            if (weight < a.weight) {
+                a.weight = weight;
+                a.middle = middle;
+                for (Arc& b : in_[to]) {
+                    if (b.to == from) {
+                        b.weight = weight;
+                        b.middle = middle;
+                    }
+                }
+            }
+            return;
+        }
+        out_[from].push_back({to, weight, middle});
+        in_[to].push_back({from, weight, middle});
+    }
+
+    double dist(int v) const { return stamp_[v] == generation_ ? dist_[v] : INF; }
+
+    // Bounded Dijkstra from source over the remainder, avoiding `avoid`
+    void witness_search(int source, int avoid, double max_cost) {
+        if (++generation_ == 0) {
+            std::fill(stamp_.begin(), stamp_.end(), 0);
+            generation_ = 1;
+        }
+
+        using Entry = std::pair<double, int>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        stamp_[source] = generation_;
+        dist_[source] = 0.0;
+        open.emplace(0.0, source);
+
+        int settled = 0;
+        while (!open.empty()) {
+            auto [d, u] = open.top();
+            open.pop();
+            if (d > dist(u)) continue;
+            if (d > max_cost || ++settled > WITNESS_SETTLE_LIMIT) break;
+
+            for (const Arc& a : out_[u]) {
+                if (a.to == avoid) continue;
+                double nd = d + a.weight;
+                if (nd < dist(a.to)) {
+                    stamp_[a.to] = generation_;
+                    dist_[a.to] = nd;
+                    open.emplace(nd, a.to);
+                }
+            }
+        }
+    }
+
+    // Shortcuts needed to preserve distances if v were removed
+    void find_shortcuts(int v, std::vector<Shortcut>& out) {
+        for (const Arc& in : in_[v]) {
+            int u = in.to;
+
+            double max_out = -1.0;
+            for (const Arc& o : out_[v]) {
+                if (o.to != u) max_out = std::max(max_out, o.weight);
+            }
+            if (max_out < 0.0) continue;   // no other neighbour to reach
+
+            witness_search(u, v, in.weight + max_out);
+
+            for (const Arc& o : out_[v]) {
+                if (o.to == u) continue;
+                double via = in.weight + o.weight;
+                if (dist(o.to) > via + 1e-9) {
+                    out.push_back({u, o.to, via});
+                }
+            }
+        }
+    }
+};
+
+// Pack per-node arc lists into CSR arrays
+void pack_arcs(const std::vector<std::vector<Arc>>& lists,
+               std::vector<int>& offsets, std::vector<int>& to,
+               std::vector<double>& weight, std::vector<int>& middle) {
+    offsets.assign(lists.size() + 1, 0);
+    for (size_t v = 0; v < lists.size(); ++v) {
+        offsets[v + 1] = offsets[v] + static_cast<int>(lists[v].size());
+    }
+    to.clear();
+    weight.clear();
+    middle.clear();
+    for (const auto& arcs : lists) {
+        for (const Arc& a : arcs) {
+            to.push_back(a.to);
+            weight.push_back(a.weight);
+            middle.push_back(a.middle);
+        }
+    }
+}
+
+}
+
+ContractionHierarchy::ContractionHierarchy(const Graph& graph) {
+    int N = graph.num_nodes();
+    if (N == 0) return;
+
+    Contractor contractor(graph);
+
+    using Entry = std::pair<int, int>;   // (priority, node)
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    for (int v = 0; v < N; ++v) {
+        queue.emplace(contractor.priority(v), v);
+    }
+
+    rank_.assign(N, -1);
+    std::vector<std::vector<Arc>> up(N), down(N);
+    std::vector<int> neighbors;
+    int next_rank = 0;
+
+    // Lazy updates: re-evaluate the popped node and defer it if it got worse
+    while (!queue.empty()) {
+        int v = queue.top().second;
+        queue.pop();
+        if (rank_[v] >= 0) continue;
+
+        int current = contractor.priority(v);
+        if (!queue.empty() && current > queue.top().first) {
+            queue.emplace(current, v);
+            continue;
+        }
+
+        contractor.contract(v, up[v], down[v], neighbors);
+        rank_[v] = next_rank++;
+    }
+
+    pack_arcs(up, up_offsets_, up_to_, up_weight_, up_middle_);
+    pack_arcs(down, down_offsets_, down_to_, down_weight_, down_middle_);
+
+    num_shortcuts_ = 0;
+    for (int m : up_middle_) num_shortcuts_ += m >= 0;
+    for (int m : down_middle_) num_shortcuts_ += m >= 0;
+}
+
+AStarResult ContractionHierarchy::shortest_path(int start_idx, int goal_idx) const {
+    return shortest_path(start_idx, goal_idx,
+                         SearchContext::local(0), SearchContext::local(1));
+}
+
+AStarResult ContractionHierarchy::shortest_path(int start_idx, int goal_idx,
+                                                SearchContext& forward,
+                                                SearchContext& backward) const {
+    int N = num_nodes();
+    BinaryHeap& fq = forward.open<BinaryHeap>();
+    BinaryHeap& bq = backward.open<BinaryHeap>();
+
+    forward.reset(N);
+    backward.reset(N);
+    fq.reset(N);
+    bq.reset(N);
+    forward.reach(start_idx, 0.0, -1);
+    backward.reach(goal_idx, 0.0, -1);
+    fq.push(start_idx, 0.0);
+    bq.push(goal_idx, 0.0);
+
+    double best = INF;
+    int meet = -1;
+
+    while (true) {
+        double f_top = fq.empty() ? INF : fq.min_key();
+        double b_top = bq.empty() ? INF : bq.min_key();
+
+        // Each side is done once its minimum can no longer improve the best
+        if (f_top >= best) f_top = INF;
+        if (b_top >= best) b_top = INF;
+        if (f_top == INF && b_top == INF) break;
+
+        bool is_forward = f_top <= b_top;
+        SearchContext& self = is_forward ? forward : backward;
+        SearchContext& other = is_forward ? backward : forward;
+        BinaryHeap& q = is_forward ? fq : bq;
+
+        int u = q.pop();
+
+        if (self.closed(u)) continue;
+        self.close(u);
+
+        double g_u = self.g(u);
+        if (other.reached(u) && g_u + other.g(u) < best) {
+            best = g_u + other.g(u);
+            meet = u;
+        }
+
+        // Relax upward arcs in this direction; arcs of the opposite
+        // direction reach u from higher nodes and are used for stalling
+        const auto& offsets  = is_forward ? up_offsets_ : down_offsets_;
+        const auto& to       = is_forward ? up_to_ : down_to_;
+        const auto& weight   = is_forward ? up_weight_ : down_weight_;
+        const auto& s_offsets = is_forward ? down_offsets_ : up_offsets_;
+        const auto& s_to      = is_forward ? down_to_ : up_to_;
+        const auto& s_weight  = is_forward ? down_weight_ : up_weight_;
+
+        // Stall-on-demand: u is not on a shortest path if a higher node
+        // already reached offers a cheaper way down to it
+        bool stalled = false;
+        for (int i = s_offsets[u]; i < s_offsets[u + 1]; ++i) {
+            if (self.g(s_to[i]) + s_weight[i] < g_u) {
+                stalled = true;
+                break;
+            }
+        }
+        if (stalled) continue;
+
+        for (int i = offsets[u]; i < offsets[u + 1]; ++i) {
+            int v = to[i];
+            double nd = g_u + weight[i];
+            if (nd < self.g(v)) {
+                self.reach(v, nd, u);
+                q.push(v, nd);
+            }
+        }
+    }
+
+    AStarResult result;
+    result.total_cost = best;
+    if (meet < 0) {
+        // No path
+        return result;
+    }
+
+    // Upward chain start .. meet, then downward chain meet .. goal
+    std::vector<int> chain;
+    for (int curr = meet; curr != -1; curr = forward.parent(curr)) {
+        chain.push_back(curr);
+    }
+    std::reverse(chain.begin(), chain.end());
+
+    result.path.push_back(start_idx);
+    for (size_t i = 1; i < chain.size(); ++i) {
+        unpack(chain[i - 1], chain[i], result.path);
+    }
+    for (int curr = meet, next = backward.parent(meet); next != -1;
+         curr = next, next = backward.parent(next)) {
+        unpack(curr, next, result.path);
+    }
+
+    return result;
+}
+
+bool ContractionHierarchy::find_arc(int from, int to, double& weight, int& middle) const {
+    bool found = false;
+    weight = INF;
+
+    if (rank_[from] < rank_[to]) {
+        for (int i = up_offsets_[from]; i < up_offsets_[from + 1]; ++i) {
+            if (up_to_[i] == to && up_weight_[i] < weight) {
+                weight = up_weight_[i];
+                middle = up_middle_[i];
+                found = true;
+            }
+        }
+    } else {
+        for (int i = down_offsets_[to]; i < down_offsets_[to + 1]; ++i) {
+            if (down_to_[i] == from && down_weight_[i] < weight) {
+                weight = down_weight_[i];
+                middle = down_middle_[i];
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+void ContractionHierarchy::unpack(int from, int to, std::vector<int>& path) const {
+    std::vector<std::pair<int, int>> stack{{from, to}};
+
+    while (!stack.empty()) {
+        auto [a, b] = stack.back();
+        stack.pop_back();
+
+        double weight;
+        int middle = -1;
+        if (!find_arc(a, b, weight, middle) || middle < 0) {
+            path.push_back(b);
+            continue;
+        }
+        stack.push_back({middle, b});
+        stack.push_back({a, middle});
+    }
+}
+
+bool ContractionHierarchy::save(const std::string& path, uint64_t graph_fingerprint) const {
+    if (empty()) return false;
+
+    SnapshotWriter writer(CH_KIND, CH_VERSION, graph_fingerprint);
+    writer.add(TAG_RANK, rank_);
+    writer.add(TAG_UP_OFFSETS, up_offsets_);
+    writer.add(TAG_UP_TO, up_to_);
+    writer.add(TAG_UP_WEIGHT, up_weight_);
+    writer.add(TAG_UP_MIDDLE, up_middle_);
+    writer.add(TAG_DN_OFFSETS, down_offsets_);
+    writer.add(TAG_DN_TO, down_to_);
+    writer.add(TAG_DN_WEIGHT, down_weight_);
+    writer.add(TAG_DN_MIDDLE, down_middle_);
+    return writer.write(path);
+}
+
+bool ContractionHierarchy::load(const std::string& path, uint64_t graph_fingerprint) {
+    SnapshotReader reader(path, CH_KIND, CH_VERSION, graph_fingerprint);
+    if (!reader.valid()) return false;
+
+    ContractionHierarchy ch;
+    if (!reader.read(TAG_RANK, ch.rank_) ||
+        !reader.read(TAG_UP_OFFSETS, ch.up_offsets_) ||
+        !reader.read(TAG_UP_TO, ch.up_to_) ||
+        !reader.read(TAG_UP_WEIGHT, ch.up_weight_) ||
+        !reader.read(TAG_UP_MIDDLE, ch.up_middle_) ||
+        !reader.read(TAG_DN_OFFSETS, ch.down_offsets_) ||
+        !reader.read(TAG_DN_TO, ch.down_to_) ||
+        !reader.read(TAG_DN_WEIGHT, ch.down_weight_) ||
+        !reader.read(TAG_DN_MIDDLE, ch.down_middle_)) {
+        return false;
+    }
+
+    size_t N = ch.rank_.size();
+    if (ch.up_offsets_.size() != N + 1 || ch.down_offsets_.size() != N + 1 ||
+        static_cast<size_t>(ch.up_offsets_.back()) != ch.up_to_.size() ||
+        static_cast<size_t>(ch.down_offsets_.back()) != ch.down_to_.size() ||
+        ch.up_weight_.size() != ch.up_to_.size() || ch.up_middle_.size() != ch.up_to_.size() ||
+        ch.down_weight_.size() != ch.down_to_.size() || ch.down_middle_.size() != ch.down_to_.size()) {
+        return false;
+    }
+
+    for (int m : ch.up_middle_) ch.num_shortcuts_ += m >= 0;
+    for (int m : ch.down_middle_) ch.num_shortcuts_ += m >= 0;
+
+    *this = std::move(ch);
+    return true;
+}
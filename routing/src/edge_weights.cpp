@@ -0,0 +1,257 @@
+#include "edge_weights.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+struct EdgeWeights::Version {
+    uint64_t number = 1;
+    double max_speed = 0.0;
+    size_t size = 0;
+    std::vector<std::shared_ptr<Stored[]>> owners;   // pages, shared between versions
+    std::vector<const Stored*> pages;
+    std::vector<double> page_speed;                  // fastest speed per page
+    std::vector<int> page_fastest;                   // and a slot that has it
+    uint64_t retired_at = 0;
+
+    void scan_page(size_t p, const SpeedOf& speed_of);
+};
+
+void EdgeWeights::Version::scan_page(size_t p, const SpeedOf& speed_of) {
+    size_t begin = p * PAGE_SIZE;
+    size_t end = std::min(size, begin + PAGE_SIZE);
+    page_speed[p] = 0.0;
+    page_fastest[p] = static_cast<int>(begin);
+    for (size_t slot = begin; slot < end; ++slot) {
+        double speed = speed_of(static_cast<int>(slot), decode(pages[p][slot - begin]));
+        if (speed > page_speed[p]) {
+            page_speed[p] = speed;
+            page_fastest[p] = static_cast<int>(slot);
+        }
+    }
+}
+
+struct EdgeWeights::State {
+    static constexpr int NUM_READERS = 128;
+
+    // Epoch a reader entered at, 0 when the slot is free
+    struct alignas(64) Reader {
+        std::atomic<uint64_t> epoch{0};
+    };
+
+    Reader readers[NUM_READERS];
+    std::atomic<Version*> current{new Version};
+    std::atomic<uint64_t> epoch{1};   // number of the current version
+
+    std::mutex writer;
+    std::vector<Version*> retired;    // guarded by writer
+
+    ~State() {
+        delete current.load();
+        for (Version* v : retired) delete v;
+    }
+
+    void replace(Version* next);
+    void reclaim();
+};
+
+void EdgeWeights::State::replace(Version* next) {
+    Version* old = current.load(std::memory_order_relaxed);
+    current.store(next);
+    epoch.store(next->number);
+
+    // Readers announcing an epoch >= next->number pinned next or later
+    old->retired_at = next->number;
+    retired.push_back(old);
+    reclaim();
+}
+
+void EdgeWeights::State::reclaim() {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const Reader& r : readers) {
+        uint64_t e = r.epoch.load();
+        if (e != 0) oldest = std::min(oldest, e);
+    }
+
+    auto kept = std::remove_if(retired.begin(), retired.end(), [&](Version* v) {
+        if (v->retired_at > oldest) return false;
+        delete v;
+        return true;
+    });
+    retired.erase(kept, retired.end());
+}
+
+EdgeWeights::Snapshot& EdgeWeights::Snapshot::operator=(Snapshot&& other) noexcept {
+    if (this != &other) {
+        release();
+        state_ = other.state_;
+        reader_ = other.reader_;
+        version_ = other.version_;
+        pages_ = other.pages_;
+        other.state_ = nullptr;
+        other.reader_ = -1;
+        other.version_ = nullptr;
+        other.pages_ = nullptr;
+    }
+    return *this;
+}
+
+void EdgeWeights::Snapshot::release() {
+    if (state_) {
+        state_->readers[reader_].epoch.store(0, std::memory_order_release);
+        state_ = nullptr;
+    }
+}
+
+uint64_t EdgeWeights::Snapshot::version() const {
+    return version_ ? version_->number : 0;
+}
+
+double EdgeWeights::Snapshot::max_speed() const {
+    return version_ ? version_->max_speed : 0.0;
+}
+
+EdgeWeights::EdgeWeights() : state_(new State) {}
+
+EdgeWeights::EdgeWeights(const EdgeWeights& other) : EdgeWeights() {
+    *this = other;
+}
+
+EdgeWeights& EdgeWeights::operator=(const EdgeWeights& other) {
+    if (this != &other) {
+        // Pages never change once published, so the copy shares them
+        Snapshot snap = other.pin();
+        State& s = *state_;
+        std::lock_guard<std::mutex> lock(s.writer);
+
+        Version* next = new Version(*snap.version_);
+        next->number = s.current.load(std::memory_order_relaxed)->number + 1;
+        next->retired_at = 0;
+        s.replace(next);
+    }
+    return *this;
+}
+
+EdgeWeights::EdgeWeights(EdgeWeights&& other) noexcept : state_(std::move(other.state_)) {
+    other.state_.reset(new State);
+}
+
+EdgeWeights& EdgeWeights::operator=(EdgeWeights&& other) noexcept {
+    std::swap(state_, other.state_);
+    return *this;
+}
+
+EdgeWeights::~EdgeWeights() = default;
+
+EdgeWeights::Snapshot EdgeWeights::pin() const {
+    State& s = *state_;
+    thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    // Claim a free reader slot, announcing the epoch we enter at. The version
+    // is loaded after the announcement, so it is at least that new.
+    Snapshot snap;
+    for (size_t i = 0;; ++i) {
+        int r = static_cast<int>((hint + i) % State::NUM_READERS);
+        uint64_t entered = s.epoch.load();
+        uint64_t expected = 0;
+        if (s.readers[r].epoch.load(std::memory_order_relaxed) == 0 &&
+            s.readers[r].epoch.compare_exchange_strong(expected, entered)) {
+            snap.reader_ = r;
+            break;
+        }
+        if (i % State::NUM_READERS == State::NUM_READERS - 1) std::this_thread::yield();
+    }
+
+    snap.state_ = &s;
+    snap.version_ = s.current.load();
+    snap.pages_ = snap.version_->pages.data();
+    return snap;
+}
+
+size_t EdgeWeights::size() const {
+    return pin().version_->size;
+}
+
+uint64_t EdgeWeights::version() const {
+    return state_->epoch.load();
+}
+
+std::vector<double> EdgeWeights::values() const {
+    Snapshot snap = pin();
+    std::vector<double> result(snap.version_->size);
+    for (size_t slot = 0; slot < result.size(); ++slot) {
+        result[slot] = snap[static_cast<int>(slot)];
+    }
+    return result;
+}
+
+void EdgeWeights::assign(const std::vector<double>& weights, const SpeedOf& speed_of) {
+    State& s = *state_;
+    std::lock_guard<std::mutex> lock(s.writer);
+
+    Version* next = new Version;
+    next->number = s.current.load(std::memory_order_relaxed)->number + 1;
+    next->size = weights.size();
+
+    size_t num_pages = (weights.size() + PAGE_SIZE - 1) / PAGE_SIZE;
+    next->page_speed.resize(num_pages);
+    next->page_fastest.resize(num_pages);
+    for (size_t p = 0; p < num_pages; ++p) {
+        std::shared_ptr<Stored[]> page(new Stored[PAGE_SIZE]());
+        size_t begin = p * PAGE_SIZE;
+        size_t end = std::min(weights.size(), begin + PAGE_SIZE);
+        std::transform(weights.begin() + begin, weights.begin() + end, page.get(), encode);
+        next->pages.push_back(page.get());
+        next->owners.push_back(std::move(page));
+
+        next->scan_page(p, speed_of);
+        next->max_speed = std::max(next->max_speed, next->page_speed[p]);
+    }
+
+    s.replace(next);
+}
+
+uint64_t EdgeWeights::publish(const std::vector<std::pair<int, double>>& updates,
+                              const SpeedOf& speed_of) {
+    State& s = *state_;
+    std::lock_guard<std::mutex> lock(s.writer);
+
+    const Version* old = s.current.load(std::memory_order_relaxed);
+    Version* next = new Version(*old);
+    next->number = old->number + 1;
+    next->retired_at = 0;
+
+    // Copy each touched page once; untouched pages stay shared. A page whose
+    // fastest slot slowed down is rescanned after all changes are in.
+    std::vector<size_t> rescan;
+    for (const auto& [slot, weight] : updates) {
+        if (slot < 0 || static_cast<size_t>(slot) >= next->size) continue;
+
+        size_t p = static_cast<size_t>(slot) >> PAGE_BITS;
+        if (next->owners[p] == old->owners[p]) {
+            std::shared_ptr<Stored[]> page(new Stored[PAGE_SIZE]);
+            std::copy(old->pages[p], old->pages[p] + PAGE_SIZE, page.get());
+            next->pages[p] = page.get();
+            next->owners[p] = std::move(page);
+        }
+        next->owners[p][slot & (PAGE_SIZE - 1)] = encode(weight);
+
+        double speed = speed_of(slot, weight);
+        if (speed >= next->page_speed[p]) {
+            next->page_speed[p] = speed;
+            next->page_fastest[p] = slot;
+        } else if (next->page_fastest[p] == slot) {
+            rescan.push_back(p);
+        }
+    }
+
+    std::sort(rescan.begin(), rescan.end());
+    rescan.erase(std::unique(rescan.begin(), rescan.end()), rescan.end());
+    for (size_t p : rescan) next->scan_page(p, speed_of);
+    next->max_speed = 0.0;
+    for (double speed : next->page_speed) next->max_speed = std::max(next->max_speed, speed);
+
+    s.replace(next);
+    return next->number;
+}
@@ -1,55 +1,310 @@
 #include "graph.h"
+#include "snapshot.h"
+#include "geo.h"
 #include <iostream>
 #include <cstdlib>
 #include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 
-void Graph::add_node(int id, double lat, double lon){
-    Node node;
-    node.id = id;
-    node.lat = lat;
-    node.lon = lon;
+namespace {
+    constexpr uint32_t GRAPH_KIND = snapshot_tag("GRPH");
+    constexpr uint32_t GRAPH_VERSION = 3;
 
-    nodes_.push_back(std::move(node));
+    constexpr uint32_t TAG_NODE_LAT = snapshot_tag("NLAT");
+    constexpr uint32_t TAG_NODE_LON = snapshot_tag("NLON");
+    constexpr uint32_t TAG_OFFSETS  = snapshot_tag("EOFF");
+    constexpr uint32_t TAG_SOURCES  = snapshot_tag("ESRC");
+    constexpr uint32_t TAG_TARGETS  = snapshot_tag("EDST");
+    constexpr uint32_t TAG_WEIGHTS  = snapshot_tag("EWGT");
+    constexpr uint32_t TAG_EDGE_ID  = snapshot_tag("EID ");
+    constexpr uint32_t TAG_SHAPE_OFF = snapshot_tag("SOFF");
+    constexpr uint32_t TAG_SHAPE    = snapshot_tag("SHAP");
 
+    constexpr double SHAPE_SCALE = 1e7;
 
+    int64_t quantize(double degrees) {
+        return std::llround(degrees * SHAPE_SCALE);
+    }
+
+    void put_varint(std::vector<uint8_t>& out, int64_t value) {
+        uint64_t v = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    int64_t get_varint(const uint8_t*& p) {
+        uint64_t v = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            v |= static_cast<uint64_t>(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        v |= static_cast<uint64_t>(*p++) << shift;
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
 }
 
-void Graph::add_edge(int id, int from, int to, double weight){
-    assert(from >= 0 && from < static_cast<int>(nodes_.size()));
-    assert(to   >= 0 && to   < static_cast<int>(nodes_.size()));
-    auto eptr = std::make_shared<Edge>();
+void Graph::add_node(double lat, double lon){
+    lat_.push_back(coord(lat));
+    lon_.push_back(coord(lon));
+}
 
-    eptr->id = id;
-    eptr->from = from;
-    eptr->to = to;
-    eptr->weight = weight;
+void Graph::add_edge(int id, int from, int to, double weight,
+                     const std::vector<std::pair<double, double>>& shape){
+    assert(!frozen_);
+    assert(from >= 0 && from < num_nodes());
+    assert(to   >= 0 && to   < num_nodes());
 
-    // Graph vector owns one shared_ptr
-    edges_.push_back(eptr);
+    pending_.push_back({id, from, to, weight});
+    pending_shape_.insert(pending_shape_.end(), shape.begin(), shape.end());
+    pending_shape_end_.push_back(pending_shape_.size());
+}
+
+void Graph::freeze() {
+    if (frozen_) return;
+
+    int N = num_nodes();
+    int E = static_cast<int>(pending_.size());
+
+    // Counting sort by source node; keeps insertion order within a node
+    offsets_.assign(N + 1, 0);
+    for (const Edge& e : pending_) {
+        offsets_[e.from + 1]++;
+    }
+    for (int i = 0; i < N; ++i) {
+        offsets_[i + 1] += offsets_[i];
+    }
+
+    sources_.resize(E);
+    targets_.resize(E);
+    edge_ids_.resize(E);
+    std::vector<double> weights(E);
+
+    std::vector<int> cursor(offsets_.begin(), offsets_.end() - 1);
+    std::vector<int> pending_of_slot(E);
+    for (int i = 0; i < E; ++i) {
+        const Edge& e = pending_[i];
+        int slot = cursor[e.from]++;
+        sources_[slot] = e.from;
+        targets_[slot] = e.to;
+        weights[slot] = e.weight;
+        edge_ids_[slot] = e.id;
+        pending_of_slot[slot] = i;
+    }
 
-    // Node also keeps a shared_ptr to the same edge
-    nodes_[from].edges.push_back(eptr);
+    // Delta-encode shape points in slot order
+    shape_offsets_.assign(E + 1, 0);
+    shape_data_.clear();
+    for (int slot = 0; slot < E; ++slot) {
+        int i = pending_of_slot[slot];
+        size_t begin = i > 0 ? pending_shape_end_[i - 1] : 0;
+        size_t end = pending_shape_end_[i];
+
+        int64_t lat = quantize(get_node_lat(sources_[slot]));
+        int64_t lon = quantize(get_node_lon(sources_[slot]));
+        for (size_t p = begin; p < end; ++p) {
+            int64_t next_lat = quantize(pending_shape_[p].first);
+            int64_t next_lon = quantize(pending_shape_[p].second);
+            put_varint(shape_data_, next_lat - lat);
+            put_varint(shape_data_, next_lon - lon);
+            lat = next_lat;
+            lon = next_lon;
+        }
+        shape_offsets_[slot + 1] = static_cast<uint32_t>(shape_data_.size());
+    }
+    shape_data_.shrink_to_fit();
+
+    pending_.clear();
+    pending_.shrink_to_fit();
+    pending_shape_.clear();
+    pending_shape_.shrink_to_fit();
+    pending_shape_end_.clear();
+    pending_shape_end_.shrink_to_fit();
+    frozen_ = true;
+
+    build_id_index();
+    build_reverse_index();
+
+    weights_.assign(weights, [this](int slot, double weight) { return speed_of(slot, weight); });
 }
 
-void Graph::update_edge_weight(int id, double new_weight) {
+void Graph::build_reverse_index() {
+    int N = num_nodes();
+    int E = num_edges();
+
+    in_offsets_.assign(N + 1, 0);
+    for (int slot = 0; slot < E; ++slot) {
+        in_offsets_[targets_[slot] + 1]++;
+    }
+    for (int i = 0; i < N; ++i) {
+        in_offsets_[i + 1] += in_offsets_[i];
+    }
+
+    in_slots_.resize(E);
+    std::vector<int> cursor(in_offsets_.begin(), in_offsets_.end() - 1);
+    for (int slot = 0; slot < E; ++slot) {
+        in_slots_[cursor[targets_[slot]]++] = slot;
+    }
+}
+
+void Graph::build_id_index() {
+    int E = num_edges();
+    id_to_slot_.clear();
+    sparse_id_to_slot_.clear();
 
-    for (auto& e : edges_) {
-        if (e->id == id) {
+    int max_id = -1;
+    bool dense = true;
+    for (int id : edge_ids_) {
+        if (id < 0) { dense = false; break; }
+        if (id > max_id) max_id = id;
+    }
+    dense = dense && max_id < 2 * E + 1024;
 
-            e->weight = new_weight;
-            return;
+    if (dense) {
+        id_to_slot_.assign(max_id + 1, -1);
+        for (int slot = E - 1; slot >= 0; --slot) {
+            id_to_slot_[edge_ids_[slot]] = slot;
+        }
+    } else {
+        sparse_id_to_slot_.reserve(E);
+        for (int slot = 0; slot < E; ++slot) {
+            sparse_id_to_slot_.emplace(edge_ids_[slot], slot);
         }
     }
 }
 
-const std::vector<Node>& Graph::nodes() const {
-    return nodes_;
+int Graph::slot_of_id(int id) const {
+    if (!sparse_id_to_slot_.empty()) {
+        auto it = sparse_id_to_slot_.find(id);
+        return it == sparse_id_to_slot_.end() ? -1 : it->second;
+    }
+    if (id < 0 || id >= static_cast<int>(id_to_slot_.size())) return -1;
+    return id_to_slot_[id];
 }
 
-std::vector<Node>& Graph::nodes_mut() {
-    return nodes_;
+void Graph::edge_shape(int slot, std::vector<std::pair<double, double>>& points) const {
+    points.clear();
+
+    int64_t lat = quantize(get_node_lat(sources_[slot]));
+    int64_t lon = quantize(get_node_lon(sources_[slot]));
+    const uint8_t* p = shape_data_.data() + shape_offsets_[slot];
+    const uint8_t* end = shape_data_.data() + shape_offsets_[slot + 1];
+    while (p < end) {
+        lat += get_varint(p);
+        lon += get_varint(p);
+        points.emplace_back(lat / SHAPE_SCALE, lon / SHAPE_SCALE);
+    }
 }
 
-std::vector<std::shared_ptr<Edge>>& Graph::edges_mut() {
-    return edges_;
+int Graph::slot_of(int from, int to) const {
+    if (from < 0 || from >= num_nodes() || !frozen_) return -1;
+
+    for (int slot = offsets_[from]; slot < offsets_[from + 1]; ++slot) {
+        if (targets_[slot] == to) return slot;
+    }
+    return -1;
+}
+
+bool Graph::save(const std::string& path, uint64_t source_hash) const {
+    if (!frozen_) return false;
+
+    std::vector<double> lats, lons;
+    lats.reserve(num_nodes());
+    lons.reserve(num_nodes());
+    for (int i = 0; i < num_nodes(); ++i) {
+        lats.push_back(get_node_lat(i));
+        lons.push_back(get_node_lon(i));
+    }
+
+    SnapshotWriter writer(GRAPH_KIND, GRAPH_VERSION, source_hash);
+    writer.add(TAG_NODE_LAT, lats);
+    writer.add(TAG_NODE_LON, lons);
+    writer.add(TAG_OFFSETS, offsets_);
+    writer.add(TAG_SOURCES, sources_);
+    writer.add(TAG_TARGETS, targets_);
+    writer.add(TAG_WEIGHTS, weights_.values());
+    writer.add(TAG_EDGE_ID, edge_ids_);
+    writer.add(TAG_SHAPE_OFF, shape_offsets_);
+    writer.add(TAG_SHAPE, shape_data_);
+    return writer.write(path);
+}
+
+bool Graph::load(const std::string& path, uint64_t source_hash) {
+    SnapshotReader reader(path, GRAPH_KIND, GRAPH_VERSION, source_hash);
+    if (!reader.valid()) return false;
+
+    std::vector<double> lats, lons, weights;
+    Graph g;
+    if (!reader.read(TAG_NODE_LAT, lats) ||
+        !reader.read(TAG_NODE_LON, lons) ||
+        !reader.read(TAG_OFFSETS, g.offsets_) ||
+        !reader.read(TAG_SOURCES, g.sources_) ||
+        !reader.read(TAG_TARGETS, g.targets_) ||
+        !reader.read(TAG_WEIGHTS, weights) ||
+        !reader.read(TAG_EDGE_ID, g.edge_ids_) ||
+        !reader.read(TAG_SHAPE_OFF, g.shape_offsets_) ||
+        !reader.read(TAG_SHAPE, g.shape_data_)) {
+        return false;
+    }
+
+    size_t N = lats.size();
+    size_t E = g.targets_.size();
+    if (lons.size() != N || g.offsets_.size() != N + 1 ||
+        g.sources_.size() != E || weights.size() != E || g.edge_ids_.size() != E ||
+        g.offsets_.front() != 0 || static_cast<size_t>(g.offsets_.back()) != E ||
+        g.shape_offsets_.size() != E + 1 || g.shape_offsets_.back() != g.shape_data_.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < N; ++i) {
+        g.add_node(lats[i], lons[i]);
+    }
+    g.frozen_ = true;
+    g.build_id_index();
+    g.build_reverse_index();
+
+    g.weights_.assign(weights, [&g](int slot, double weight) { return g.speed_of(slot, weight); });
+
+    *this = std::move(g);
+    return true;
+}
+
+uint64_t Graph::fingerprint() const {
+    uint64_t h = hash_bytes(offsets_.data(), offsets_.size() * sizeof(int));
+    h = hash_bytes(targets_.data(), targets_.size() * sizeof(int), h);
+    std::vector<double> weights = weights_.values();
+    h = hash_bytes(weights.data(), weights.size() * sizeof(double), h);
+    return h;
+}
+
+void Graph::update_edge_weight(int id, double new_weight) {
+    int slot = slot_of_id(id);
+    if (slot >= 0) {
+        set_edge_weight(slot, new_weight);
+    }
+}
+
+void Graph::set_edge_weight(int slot, double weight) {
+    set_edge_weights({{slot, weight}});
+}
+
+uint64_t Graph::set_edge_weights(const std::vector<std::pair<int, double>>& updates) {
+    return weights_.publish(updates,
+                            [this](int slot, double weight) { return speed_of(slot, weight); });
+}
+
+double Graph::speed_of(int slot, double weight) const {
+    Node a = node(sources_[slot]);
+    Node b = node(targets_[slot]);
+    double length = haversine(a.lat, a.lon, b.lat, b.lon);
+    if (length <= 0.0) return 0.0;
+
+    // Bound the weight as stored, which may be rounded
+    weight = EdgeWeights::round(weight);
+    return weight > 0.0 ? length / weight : std::numeric_limits<double>::infinity();
 }
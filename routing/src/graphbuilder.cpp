@@ -1,12 +1,17 @@
 #include "graphbuilder.h"
 #include "osm_parser.h"
 #include "graph.h"
+#include "snapshot.h"
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/visitor.hpp>
 
 #include <iostream>
 #include <cstdlib>
 #include <cmath>  // for sin, cos, atan2, sqrt
 
 #include <unordered_set>
+#include <queue>
 
 std::unordered_map<int64_t, int> GraphBuilder::find_intersections(){
     std::unordered_map<int64_t, int> table;
@@ -43,6 +48,35 @@ double GraphBuilder::haversine(OSMNode& n1, OSMNode& n2) {
 
 }
 
+Graph GraphBuilder::load_or_build(const std::string& osm_file) {
+    uint64_t source_hash = hash_file(osm_file);
+    std::string cache_file = osm_file + ".graph";
+
+    Graph graph;
+    if (source_hash != 0 && graph.load(cache_file, source_hash)) {
+        return graph;
+    }
+
+    OSMHandler handler;
+    osmium::io::Reader reader(osm_file);
+    osmium::apply(reader, handler);
+    reader.close();
+
+    if (handler.nodes.empty() || handler.ways.empty()) {
+        return Graph();
+    }
+
+    GraphBuilder builder(std::move(handler.nodes), std::move(handler.ways));
+    graph = builder.build_graph();
+
+    // Best effort: an unwritable directory only means the next start parses again
+    if (source_hash != 0 && graph.num_nodes() > 0) {
+        graph.save(cache_file, source_hash);
+    }
+
+    return graph;
+}
+
 bool GraphBuilder::is_endpoint(int node_id, OSMWay& way){
     return node_id ==  way.node_ids.front() || node_id == way.node_ids.back();   
 }
@@ -76,7 +110,7 @@ Graph GraphBuilder::build_graph() {
     for (int64_t node_id : routing_nodes) {
         const OSMNode& osm = nodes_.at(node_id);
         id_to_index[node_id] = idx;
-        graph.add_node(idx, osm.lat, osm.lon);
+        graph.add_node(osm.lat, osm.lon);
         idx++;
     }
 
@@ -89,6 +123,7 @@ Graph GraphBuilder::build_graph() {
 
         int64_t prev_routing_node = -1;
         double acc_distance = 0.0;
+        std::vector<std::pair<double, double>> shape;   // points since prev_routing_node
 
         for (size_t i = 1; i < way.node_ids.size(); ++i) {
             int64_t prev_id = way.node_ids[i - 1];
@@ -107,32 +142,39 @@ Graph GraphBuilder::build_graph() {
                     int from = id_to_index.at(prev_routing_node);
                     int to   = id_to_index.at(curr_id);
 
+                    std::vector<std::pair<double, double>> reversed(shape.rbegin(), shape.rend());
+
                     if (way.oneway == OneWay::Forward) {
-                        graph.add_edge(way.id, from, to, eta);
+                        graph.add_edge(way.id, from, to, eta, shape);
                     }
                     else if (way.oneway == OneWay::Backward) {
-                        graph.add_edge(way.id, to, from, eta);
+                        graph.add_edge(way.id, to, from, eta, reversed);
                     }
                     else {
-                        graph.add_edge(way.id, from, to, eta);
-                        graph.add_edge(way.id, to, from, eta);
+                        graph.add_edge(way.id, from, to, eta, shape);
+                        graph.add_edge(way.id, to, from, eta, reversed);
                     }
                 }
 
                 // Reset for next segment
                 prev_routing_node = curr_id;
                 acc_distance = 0.0;
+                shape.clear();
+            }
+            else if (prev_routing_node != -1) {
+                shape.emplace_back(curr_node.lat, curr_node.lon);
             }
         }
     }
 
+    graph.freeze();
     graph = filter_largest_connected_component(graph);
 
     return graph;
 }
 
 Graph GraphBuilder::filter_largest_connected_component(const Graph& original) {
-    int N = original.nodes().size();
+    int N = original.num_nodes();
     std::vector<bool> visited(N, false);
     std::vector<std::vector<int>> components;
 
@@ -149,8 +191,8 @@ Graph GraphBuilder::filter_largest_connected_component(const Graph& original) {
             int curr = q.front(); q.pop();
             component.push_back(curr);
 
-            for (const auto& neighbor_pair : original.neighbors(curr)) {
-                int neighbor = neighbor_pair.first;
+            for (int e = original.edge_begin(curr); e < original.edge_end(curr); ++e) {
+                int neighbor = original.edge_target(e);
                 if (!visited[neighbor]) {
                     visited[neighbor] = true;
                     q.push(neighbor);
@@ -184,7 +226,6 @@ Graph GraphBuilder::filter_largest_connected_component(const Graph& original) {
     for (int old_idx : main_component) {
         old_to_new[old_idx] = new_idx;
         filtered_graph.add_node(
-            new_idx,
             original.get_node_lat(old_idx),
             original.get_node_lon(old_idx)
         );
@@ -192,19 +233,23 @@ Graph GraphBuilder::filter_largest_connected_component(const Graph& original) {
     }
 
     int edge_ind = 0;
+    std::vector<std::pair<double, double>> shape;
+    EdgeWeights::Snapshot weights = original.weights();
 
     for (int old_idx : main_component) {
         int new_from = old_to_new[old_idx];
-        for (const auto& neighbor_pair : original.neighbors(old_idx)) {
-            int old_to = neighbor_pair.first;
-            double eta = neighbor_pair.second;
+        for (int e = original.edge_begin(old_idx); e < original.edge_end(old_idx); ++e) {
+            int old_to = original.edge_target(e);
+            double eta = weights[e];
             if (main_nodes.count(old_to)) {
                 int new_to = old_to_new[old_to];
-                filtered_graph.add_edge(edge_ind, new_from, new_to, eta);
+                original.edge_shape(e, shape);
+                filtered_graph.add_edge(edge_ind, new_from, new_to, eta, shape);
                 edge_ind ++;
             }
         }
     }
 
+    filtered_graph.freeze();
     return filtered_graph;
 }
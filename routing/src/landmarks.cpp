@@ -0,0 +1,217 @@
+#include "landmarks.h"
+#include "search_kernel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <functional>
+#include <limits>
+#include <random>
+#include <utility>
+
+namespace {
+
+const double INF = std::numeric_limits<double>::infinity();
+
+std::vector<double> current_weights(const Graph& graph) {
+    EdgeWeights::Snapshot weights = graph.weights();
+    std::vector<double> result(graph.num_edges());
+    for (int slot = 0; slot < graph.num_edges(); ++slot) result[slot] = weights[slot];
+    return result;
+}
+
+// Dijkstra from one node to every other, over outgoing edges (d(source, v))
+// or incoming ones (d(v, source)). Optionally records the shortest-path tree
+// and the order in which nodes were settled.
+void one_to_all(const Graph& graph, const std::vector<double>& weights, int source,
+                bool backward, std::vector<double>& dist,
+                std::vector<int>* parent = nullptr,
+                std::vector<int>* order = nullptr) {
+    if (order) order->clear();
+    auto visit = [&](int v, double) {
+        if (order) order->push_back(v);
+        return true;
+    };
+
+    SearchContext& ctx = SearchContext::local();
+    VisitUntil<decltype(visit)> stop{visit};
+    QuaternaryHeap& open = ctx.open<QuaternaryHeap>();
+    if (backward) {
+        SearchKernel<InEdges, ZeroHeuristic, decltype(stop)>::run(
+            graph, weights, source, ctx, open, ZeroHeuristic(), stop);
+    } else {
+        SearchKernel<OutEdges, ZeroHeuristic, decltype(stop)>::run(
+            graph, weights, source, ctx, open, ZeroHeuristic(), stop);
+    }
+
+    int N = graph.num_nodes();
+    dist.resize(N);
+    if (parent) parent->resize(N);
+    for (int v = 0; v < N; ++v) {
+        dist[v] = ctx.g(v);
+        if (parent) (*parent)[v] = ctx.parent(v);
+    }
+}
+
+// Exact-precision tables used while landmarks are still being chosen
+struct Tables {
+    std::vector<std::vector<double>> from;
+    std::vector<std::vector<double>> to;
+
+    void add(const Graph& graph, const std::vector<double>& weights, int landmark) {
+        from.emplace_back();
+        to.emplace_back();
+        one_to_all(graph, weights, landmark, false, from.back());
+        one_to_all(graph, weights, landmark, true, to.back());
+    }
+
+    double lower_bound(int v, int t) const {
+        double best = 0.0;
+        for (size_t k = 0; k < from.size(); ++k) {
+            best = std::max(best, from[k][t] - from[k][v]);
+            best = std::max(best, to[k][v] - to[k][t]);
+        }
+        return best;
+    }
+};
+
+// Reachable node whose nearest source is farthest away, or -1 when none is left
+int farthest(const std::vector<std::vector<double>>& from_sources,
+             const std::vector<char>& taken) {
+    int N = static_cast<int>(taken.size());
+    int best = -1;
+    double best_dist = -1.0;
+    for (int v = 0; v < N; ++v) {
+        if (taken[v]) continue;
+        double nearest = INF;
+        for (const auto& dist : from_sources) nearest = std::min(nearest, dist[v]);
+        if (nearest != INF && nearest > best_dist) {
+            best = v;
+            best_dist = nearest;
+        }
+    }
+    return best;
+}
+
+// Avoid: in the shortest-path tree of a random root, weigh each node by how
+// badly the current landmarks bound its distance from the root, then walk
+// down into the heaviest landmark-free subtree to a leaf
+int avoid_from(const Graph& graph, const std::vector<double>& weights, int root,
+               const Tables& tables, const std::vector<char>& taken) {
+    int N = graph.num_nodes();
+    std::vector<double> dist;
+    std::vector<int> parent, order;
+    one_to_all(graph, weights, root, false, dist, &parent, &order);
+
+    std::vector<double> size(N, 0.0);
+    std::vector<char> covered(N, 0);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        int v = *it;
+        if (taken[v]) covered[v] = 1;
+        if (covered[v]) {
+            size[v] = 0.0;
+        } else {
+            size[v] += dist[v] - tables.lower_bound(root, v);
+        }
+
+        int p = parent[v];
+        if (p >= 0) {
+            if (covered[v]) covered[p] = 1;
+            size[p] += size[v];
+        }
+    }
+
+    // Children of each node in the tree
+    std::vector<int> child_offsets(N + 1, 0), children(order.size());
+    for (int v : order) {
+        if (parent[v] >= 0) child_offsets[parent[v] + 1]++;
+    }
+    for (int v = 0; v < N; ++v) child_offsets[v + 1] += child_offsets[v];
+    std::vector<int> cursor(child_offsets.begin(), child_offsets.end() - 1);
+    for (int v : order) {
+        if (parent[v] >= 0) children[cursor[parent[v]]++] = v;
+    }
+
+    int current = root;
+    while (true) {
+        int next = -1;
+        for (int i = child_offsets[current]; i < child_offsets[current + 1]; ++i) {
+            int c = children[i];
+            if (size[c] > 0.0 && (next < 0 || size[c] > size[next])) next = c;
+        }
+        if (next < 0) break;
+        current = next;
+    }
+    return current == root || taken[current] ? -1 : current;
+}
+
+}
+
+Landmarks::Landmarks(const Graph& graph, int count, Selection selection)
+    : Landmarks(graph, current_weights(graph), count, selection) {}
+
+Landmarks::Landmarks(const Graph& graph, const std::vector<double>& weights, int count,
+                     Selection selection) {
+    int N = graph.num_nodes();
+    if (N == 0 || count <= 0) return;
+    count = std::min(count, N);
+
+    Tables tables;
+    std::vector<char> taken(N, 0);
+    std::mt19937 rng(N);
+
+    auto add = [&](int v) {
+        landmarks_.push_back(v);
+        taken[v] = 1;
+        tables.add(graph, weights, v);
+    };
+
+    // Seed with the node farthest from a random start
+    std::vector<std::vector<double>> seed(1);
+    one_to_all(graph, weights, static_cast<int>(rng() % N), false, seed[0]);
+    int first = farthest(seed, taken);
+    add(first >= 0 ? first : 0);
+
+    while (count > static_cast<int>(landmarks_.size())) {
+        int next = -1;
+        if (selection == Selection::Avoid) {
+            for (int attempt = 0; attempt < 8 && next < 0; ++attempt) {
+                next = avoid_from(graph, weights, static_cast<int>(rng() % N), tables, taken);
+            }
+        }
+        if (next < 0) next = farthest(tables.from, taken);
+        if (next < 0) break;
+        add(next);
+    }
+
+    // Pack node-major as floats
+    int K = static_cast<int>(landmarks_.size());
+    from_.resize(static_cast<size_t>(N) * K);
+    to_.resize(static_cast<size_t>(N) * K);
+    for (int v = 0; v < N; ++v) {
+        for (int k = 0; k < K; ++k) {
+            from_[static_cast<size_t>(v) * K + k] = static_cast<float>(tables.from[k][v]);
+            to_[static_cast<size_t>(v) * K + k]   = static_cast<float>(tables.to[k][v]);
+        }
+    }
+}
+
+double Landmarks::lower_bound(int v, int t) const {
+    size_t K = landmarks_.size();
+    const float* from_v = &from_[v * K];
+    const float* from_t = &from_[t * K];
+    const float* to_v = &to_[v * K];
+    const float* to_t = &to_[t * K];
+
+    // x - y, less the worst-case rounding of both floats
+    auto difference = [](double x, double y) {
+        if (x == INF) return y == INF ? 0.0 : INF;
+        return (x - y) - (x + y) * FLT_EPSILON;
+    };
+
+    double best = 0.0;
+    for (size_t k = 0; k < K; ++k) {
+        best = std::max(best, difference(from_t[k], from_v[k]));
+        best = std::max(best, difference(to_v[k], to_t[k]));
+    }
+    return best;
+}
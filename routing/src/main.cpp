@@ -5,12 +5,14 @@
 #include "matching.h"
 #include <osmium/io/any_input.hpp>
 #include <osmium/visitor.hpp>
+#include <array>
 #include <iostream>
 #include <vector>
 #include <thread>
 #include <chrono>
 #include <random>
 #include <iomanip>
+#include <cmath>
 
 // Debug helper to print current offers
 void print_offers_debug(const MatchingEngine& engine) {
@@ -335,6 +337,104 @@ void interactive_test(RoutingEngine& routing_engine) {
     std::cout << "Interactive test complete.\n";
 }
 
+void validate_search_modes(RoutingEngine& routing_engine) {
+    std::cout << "\n=== Search Mode Validation (against Dijkstra) ===\n";
+
+    routing_engine.prepare_landmarks();
+    routing_engine.prepare_customizable_hierarchy();
+
+    const std::pair<const char*, SearchMode> modes[] = {
+        {"A*",  SearchMode::AStar},
+        {"ALT", SearchMode::ALT},
+        {"CH",  SearchMode::CH},
+        {"CCH", SearchMode::CCH},
+    };
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> lat(43.64, 43.72);
+    std::uniform_real_distribution<double> lon(-79.45, -79.30);
+    
+    const int queries = 100;
+    int mismatches[4] = {0, 0, 0, 0};
+    for (int i = 0; i < queries; i++) {
+        double lat1 = lat(rng), lon1 = lon(rng);
+        double lat2 = lat(rng), lon2 = lon(rng);
+        
+        double expected = routing_engine.route(lat1, lon1, lat2, lon2, SearchMode::Dijkstra);
+        for (int m = 0; m < 4; m++) {
+            double actual = routing_engine.route(lat1, lon1, lat2, lon2, modes[m].second);
+        
+            if (std::abs(expected - actual) > 1e-6) {
+                mismatches[m]++;
+                std::cout << "  Mismatch: (" << lat1 << ", " << lon1 << ") -> (" << lat2 << ", " << lon2
+                          << "): dijkstra=" << expected << " " << modes[m].first << "=" << actual << "\n";
+            }
+        }
+    }
+    
+    for (int m = 0; m < 4; m++) {
+        std::cout << (queries - mismatches[m]) << "/" << queries << " " << modes[m].first
+                  << " routes match Dijkstra\n";
+    }
+}
+
+void benchmark_queues(RoutingEngine& routing_engine) {
+    std::cout << "\n=== Priority Queue Benchmark ===\n";
+
+    routing_engine.prepare_landmarks();
+
+    const std::pair<const char*, SearchMode> modes[] = {
+        {"Dijkstra", SearchMode::Dijkstra},
+        {"Bidir",    SearchMode::Bidirectional},
+        {"A*",       SearchMode::AStar},
+        {"ALT",      SearchMode::ALT},
+    };
+    const std::pair<const char*, QueueKind> queues[] = {
+        {"binary", QueueKind::Binary},
+        {"4-ary",  QueueKind::Quaternary},
+        {"radix",  QueueKind::Radix},
+    };
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> lat(43.64, 43.72);
+    std::uniform_real_distribution<double> lon(-79.45, -79.30);
+
+    const int queries = 200;
+    std::vector<std::array<double, 4>> points;
+    for (int i = 0; i < queries; i++) {
+        points.push_back({lat(rng), lon(rng), lat(rng), lon(rng)});
+    }
+
+    QueueKind original = routing_engine.queue();
+    for (const auto& [mode_name, mode] : modes) {
+        std::vector<double> expected;
+        for (const auto& [queue_name, queue] : queues) {
+            routing_engine.set_queue(queue);
+
+            int mismatches = 0;
+            auto start_time = std::chrono::steady_clock::now();
+            for (int i = 0; i < queries; i++) {
+                const auto& p = points[i];
+                double cost = routing_engine.route(p[0], p[1], p[2], p[3], mode);
+                if (expected.size() < points.size()) {
+                    expected.push_back(cost);
+                } else if (std::abs(expected[i] - cost) > 1e-6) {
+                    mismatches++;
+                }
+            }
+            auto end_time = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+            std::cout << std::left << std::setw(10) << mode_name << std::setw(8) << queue_name
+                      << std::right << std::fixed << std::setprecision(3)
+                      << ms / queries << " ms/query";
+            if (mismatches > 0) std::cout << "  (" << mismatches << " mismatches)";
+            std::cout << "\n";
+        }
+    }
+    routing_engine.set_queue(original);
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0] << " <osm_file.osm.pbf> [test_mode]\n";
@@ -344,6 +444,8 @@ int main(int argc, char* argv[]) {
         std::cerr << "  diagnostic  - Diagnostic matching test\n";
         std::cerr << "  interactive - Interactive mode\n";
         std::cerr << "  performance - Performance test\n";
+        std::cerr << "  validate    - Check A*, ALT, CH and CCH routes against Dijkstra\n";
+        std::cerr << "  queues      - Time the search priority queues on random queries\n";
         std::cerr << "\nExamples:\n";
         std::cerr << "  " << argv[0] << " toronto.osm.pbf\n";
         std::cerr << "  " << argv[0] << " toronto.osm.pbf simple\n";
@@ -355,28 +457,19 @@ int main(int argc, char* argv[]) {
     std::string mode = (argc > 2) ? argv[2] : "basic";
     
     try {
-        // 1. Load OSM data
-        std::cout << "Loading OSM data from " << osm_file << "...\n";
-        
-        OSMHandler handler;
-        osmium::io::Reader reader(osm_file);
-        osmium::apply(reader, handler);
-        reader.close();
+        // 1. Load graph (cached snapshot, or parse OSM and build)
+        std::cout << "Loading graph for " << osm_file << "...\n";
         
-        std::cout << "Loaded " << handler.nodes.size() << " nodes and " 
-                  << handler.ways.size() << " ways.\n";
+        Graph graph = GraphBuilder::load_or_build(osm_file);
         
-        // 2. Build graph
-        GraphBuilder builder(std::move(handler.nodes), std::move(handler.ways));
-        Graph graph = builder.build_graph();
+        std::cout << "Built graph with " << graph.num_nodes() << " nodes.\n";
         
-        std::cout << "Built graph with " << graph.nodes().size() << " nodes.\n";
-        
-        // 3. Create routing engine
+        // 2. Create routing engine
         RoutingEngine routing_engine(graph);
+        routing_engine.prepare_hierarchy(osm_file + ".ch");
         std::cout << "Routing engine created.\n";
         
-        // 4. Run tests based on command line argument
+        // 3. Run tests based on command line argument
         if (mode == "simple") {
             simple_matching_test(routing_engine);
         }
@@ -388,6 +481,12 @@ int main(int argc, char* argv[]) {
             basic_routing_test(routing_engine);
             interactive_test(routing_engine);
         }
+        else if (mode == "validate") {
+            validate_search_modes(routing_engine);
+        }
+        else if (mode == "queues") {
+            benchmark_queues(routing_engine);
+        }
         else if (mode == "performance") {
             std::cout << "\n=== Performance Test ===\n";
             
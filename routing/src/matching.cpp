@@ -15,7 +15,7 @@ MatchingEngine::~MatchingEngine() {
 
 // H3 helper functions
 H3Index MatchingEngine::location_to_h3(const Location& loc, int res) const {
-    LatLng coord = {loc.lat, loc.lon};
+    LatLng coord = {degsToRads(loc.lat), degsToRads(loc.lon)};  // H3 takes radians
     H3Index cell;
     latLngToCell(&coord, res, &cell);
     return cell;
@@ -95,6 +95,12 @@ void MatchingEngine::add_driver(int id, double ask, double lat, double lon) {
     // Add to H3 spatial index
     H3Index cell = location_to_h3(driver.loc, H3_RES);
     drivers_by_cell_[cell].push_back(id);
+
+    // Snap once, so rider searches can pick drivers up by graph node
+    if (router_) {
+        driver.node = router_->nearest_node(lat, lon);
+        if (driver.node >= 0) drivers_by_node_[driver.node].push_back(id);
+    }
     
     std::cout << "Driver " << id << " added (ask: $" << ask << ")\n";
 }
@@ -154,6 +160,7 @@ void MatchingEngine::driver_cancel(int driver_id) {
     auto& cell_drivers = drivers_by_cell_[cell];
     cell_drivers.erase(std::remove(cell_drivers.begin(), cell_drivers.end(), driver_id), 
                       cell_drivers.end());
+    remove_from_node_index(it->second);
     
     drivers_.erase(it);
     std::cout << "Driver " << driver_id << " cancelled\n";
@@ -217,6 +224,10 @@ void MatchingEngine::matching_worker() {
 
 // Find closest drivers
 std::vector<int> MatchingEngine::find_k_closest_drivers(const Rider& rider, int k) {
+    if (router_) {
+        return find_k_closest_by_road(rider, k);
+    }
+
     std::vector<std::pair<double, int>> candidates;
     
     H3Index rider_cell = location_to_h3(rider.loc, H3_RES);
@@ -251,6 +262,54 @@ std::vector<int> MatchingEngine::find_k_closest_drivers(const Rider& rider, int
     return result;
 }
 
+// Reverse search from the rider's node: drivers come out in order of their
+// road time to the rider, so the first k eligible ones are the answer. The
+// search ends at MAX_PICKUP_SEC, so a shortage of drivers does not make it
+// settle the whole graph.
+std::vector<int> MatchingEngine::find_k_closest_by_road(const Rider& rider, int k) {
+    std::vector<int> result;
+
+    auto eligible = [&](const Driver& driver) {
+        return driver.state == State::OPEN && driver.ask <= rider.bid && driver.node >= 0;
+    };
+
+    // Stop as soon as every eligible driver has been seen, even if fewer than k
+    int wanted = 0;
+    for (const auto& pair : drivers_) {
+        if (eligible(pair.second)) wanted++;
+    }
+    wanted = std::min(k, wanted);
+    if (wanted == 0) return result;
+
+    router_->scan_toward(rider.loc.lat, rider.loc.lon, [&](int node, double cost) {
+        if (cost > MAX_PICKUP_SEC) return false;
+
+        auto node_it = drivers_by_node_.find(node);
+        if (node_it == drivers_by_node_.end()) return true;
+
+        for (int driver_id : node_it->second) {
+            auto driver_it = drivers_.find(driver_id);
+            if (driver_it == drivers_.end() || !eligible(driver_it->second)) continue;
+
+            result.push_back(driver_id);
+            if (static_cast<int>(result.size()) == wanted) return false;
+        }
+        return true;
+    });
+
+    return result;
+}
+
+void MatchingEngine::remove_from_node_index(const Driver& driver) {
+    auto node_it = drivers_by_node_.find(driver.node);
+    if (node_it == drivers_by_node_.end()) return;
+
+    auto& node_drivers = node_it->second;
+    node_drivers.erase(std::remove(node_drivers.begin(), node_drivers.end(), driver.id),
+                       node_drivers.end());
+    if (node_drivers.empty()) drivers_by_node_.erase(node_it);
+}
+
 void MatchingEngine::send_offers(int rider_id, const std::vector<int>& driver_ids) {
     // Add rider to drivers' inboxes
     for (int driver_id : driver_ids) {
@@ -277,6 +336,7 @@ void MatchingEngine::cleanup_after_match(int rider_id, int driver_id) {
         auto& cell_drivers = drivers_by_cell_[cell];
         cell_drivers.erase(std::remove(cell_drivers.begin(), cell_drivers.end(), driver_id), 
                           cell_drivers.end());
+        remove_from_node_index(driver_it->second);
     }
     
     // Get rider's pending drivers
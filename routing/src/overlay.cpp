@@ -0,0 +1,115 @@
+#include "overlay.h"
+#include "snapshot.h"
+
+#include <functional>
+#include <limits>
+#include <utility>
+
+namespace {
+    constexpr uint32_t OVERLAY_KIND = snapshot_tag("OVLY");
+    constexpr uint32_t OVERLAY_VERSION = 1;
+
+    // Per layer: slots, weights, expiries
+    constexpr uint32_t TAG_SLOTS[]   = {snapshot_tag("TSLT"), snapshot_tag("ISLT"), snapshot_tag("MSLT")};
+    constexpr uint32_t TAG_WEIGHTS[] = {snapshot_tag("TWGT"), snapshot_tag("IWGT"), snapshot_tag("MWGT")};
+    constexpr uint32_t TAG_EXPIRES[] = {snapshot_tag("TEXP"), snapshot_tag("IEXP"), snapshot_tag("MEXP")};
+}
+
+WeightOverlay::WeightOverlay(std::vector<double> baseline) : baseline_(std::move(baseline)) {}
+
+double WeightOverlay::effective(int slot) const {
+    for (int l = NUM_LAYERS - 1; l >= 0; --l) {
+        auto it = layers_[l].find(slot);
+        if (it != layers_[l].end()) return it->second.weight;
+    }
+    return baseline_[slot];
+}
+
+void WeightOverlay::set(OverrideLayer layer, int slot, double weight, double expires,
+                        std::vector<int>& touched) {
+    if (slot < 0 || slot >= static_cast<int>(baseline_.size())) return;
+
+    layers_[index(layer)][slot] = {weight, expires};
+    if (expires > 0.0) expiries_.emplace(expires, index(layer), slot);
+    touched.push_back(slot);
+}
+
+void WeightOverlay::clear(OverrideLayer layer, int slot, std::vector<int>& touched) {
+    if (layers_[index(layer)].erase(slot) > 0) touched.push_back(slot);
+}
+
+void WeightOverlay::clear(OverrideLayer layer, std::vector<int>& touched) {
+    auto& overrides = layers_[index(layer)];
+    for (const auto& entry : overrides) touched.push_back(entry.first);
+    overrides.clear();
+}
+
+double WeightOverlay::next_expiry() const {
+    return expiries_.empty() ? std::numeric_limits<double>::infinity()
+                             : std::get<0>(expiries_.top());
+}
+
+void WeightOverlay::expire(double now, std::vector<int>& touched) {
+    while (!expiries_.empty() && std::get<0>(expiries_.top()) <= now) {
+        auto [expires, l, slot] = expiries_.top();
+        expiries_.pop();
+
+        auto it = layers_[l].find(slot);
+        if (it != layers_[l].end() && it->second.expires == expires) {
+            layers_[l].erase(it);
+            touched.push_back(slot);
+        }
+    }
+}
+
+uint64_t WeightOverlay::baseline_hash() const {
+    return hash_bytes(baseline_.data(), baseline_.size() * sizeof(double));
+}
+
+bool WeightOverlay::save(const std::string& path) const {
+    SnapshotWriter writer(OVERLAY_KIND, OVERLAY_VERSION, baseline_hash());
+    for (int l = 0; l < NUM_LAYERS; ++l) {
+        std::vector<int> slots;
+        std::vector<double> weights, expires;
+        slots.reserve(layers_[l].size());
+        weights.reserve(layers_[l].size());
+        expires.reserve(layers_[l].size());
+        for (const auto& [slot, o] : layers_[l]) {
+            slots.push_back(slot);
+            weights.push_back(o.weight);
+            expires.push_back(o.expires);
+        }
+        writer.add(TAG_SLOTS[l], slots);
+        writer.add(TAG_WEIGHTS[l], weights);
+        writer.add(TAG_EXPIRES[l], expires);
+    }
+    return writer.write(path);
+}
+
+bool WeightOverlay::load(const std::string& path, std::vector<int>& touched) {
+    SnapshotReader reader(path, OVERLAY_KIND, OVERLAY_VERSION, baseline_hash());
+    if (!reader.valid()) return false;
+
+    std::vector<int> slots[NUM_LAYERS];
+    std::vector<double> weights[NUM_LAYERS], expires[NUM_LAYERS];
+    for (int l = 0; l < NUM_LAYERS; ++l) {
+        if (!reader.read(TAG_SLOTS[l], slots[l]) ||
+            !reader.read(TAG_WEIGHTS[l], weights[l]) ||
+            !reader.read(TAG_EXPIRES[l], expires[l]) ||
+            weights[l].size() != slots[l].size() || expires[l].size() != slots[l].size()) {
+            return false;
+        }
+        for (int slot : slots[l]) {
+            if (slot < 0 || slot >= static_cast<int>(baseline_.size())) return false;
+        }
+    }
+
+    for (int l = 0; l < NUM_LAYERS; ++l) clear(static_cast<OverrideLayer>(l), touched);
+    expiries_ = {};
+    for (int l = 0; l < NUM_LAYERS; ++l) {
+        for (size_t i = 0; i < slots[l].size(); ++i) {
+            set(static_cast<OverrideLayer>(l), slots[l][i], weights[l][i], expires[l][i], touched);
+        }
+    }
+    return true;
+}
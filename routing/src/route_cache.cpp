@@ -0,0 +1,136 @@
+#include "route_cache.h"
+
+#include <algorithm>
+
+RouteCache::RouteCache(size_t capacity) {
+    reset(capacity);
+}
+
+void RouteCache::reset(size_t capacity) {
+    capacity_ = capacity;
+    shard_capacity_ = (capacity + NUM_SHARDS - 1) / NUM_SHARDS;
+    shards_.reset(capacity > 0 ? new Shard[NUM_SHARDS] : nullptr);
+    log_.assign(capacity > 0 ? LOG_SIZE : 0, Change{-1, false});
+    hits_ = 0;
+    misses_ = 0;
+    invalidations_ = 0;
+}
+
+RouteCache::Shard& RouteCache::shard_of(uint64_t key) const {
+    // Mix both node indices so neighbouring pairs spread across shards
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    return shards_[(h >> 32) % NUM_SHARDS];
+}
+
+void RouteCache::Shard::erase(std::list<Entry>::iterator it) {
+    slots -= charge(*it);
+    index.erase(it->key);
+    lru.erase(it);
+}
+
+bool RouteCache::still_valid(Entry& entry, const MayImprove& may_improve) const {
+    std::shared_lock<std::shared_mutex> lock(log_mutex_);
+    uint64_t logged = logged_.load(std::memory_order_acquire);
+    if (entry.checked >= logged) return true;
+    if (logged - entry.checked > MAX_CHECK) return false;
+
+    int start = static_cast<int>(entry.key >> 32);
+    int goal = static_cast<int>(entry.key & 0xFFFFFFFFu);
+    for (uint64_t i = entry.checked; i < logged; ++i) {
+        const Change& change = log_[i % LOG_SIZE];
+        if (std::binary_search(entry.slots.begin(), entry.slots.end(), change.slot)) {
+            return false;
+        }
+        if (change.decreased && may_improve(start, goal, entry.cost, change.slot)) {
+            return false;
+        }
+    }
+    entry.checked = logged;
+    return true;
+}
+
+bool RouteCache::lookup(int start, int goal, double& cost, const MayImprove& may_improve) {
+    if (!enabled()) return false;
+
+    uint64_t key = key_of(start, goal);
+    Shard& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (!still_valid(*it->second, may_improve)) {
+        shard.erase(it->second);
+        invalidations_.fetch_add(1, std::memory_order_relaxed);
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    cost = it->second->cost;
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void RouteCache::insert(int start, int goal, double cost, std::vector<int> slots,
+                        uint64_t stamp) {
+    if (!enabled()) return;
+
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    if (slots.size() + 1 > shard_capacity_) return;
+
+    uint64_t key = key_of(start, goal);
+    Shard& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) shard.erase(it->second);
+
+    shard.lru.push_front({key, cost, stamp, std::move(slots)});
+    shard.index[key] = shard.lru.begin();
+    shard.slots += charge(shard.lru.front());
+
+    while (shard.slots > shard_capacity_) {
+        shard.erase(std::prev(shard.lru.end()));
+    }
+}
+
+void RouteCache::record(const std::vector<int>& increased, const std::vector<int>& decreased) {
+    if (!enabled() || (increased.empty() && decreased.empty())) return;
+
+    std::unique_lock<std::shared_mutex> lock(log_mutex_);
+    uint64_t logged = logged_.load(std::memory_order_relaxed);
+    for (int slot : increased) log_[logged++ % LOG_SIZE] = {slot, false};
+    for (int slot : decreased) log_[logged++ % LOG_SIZE] = {slot, true};
+    logged_.store(logged, std::memory_order_release);
+}
+
+void RouteCache::clear() {
+    if (!enabled()) return;
+
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        invalidations_.fetch_add(shard.lru.size(), std::memory_order_relaxed);
+        shard.lru.clear();
+        shard.index.clear();
+        shard.slots = 0;
+    }
+}
+
+RouteCache::Stats RouteCache::stats() const {
+    Stats result{hits_.load(), misses_.load(), invalidations_.load(), 0, 0};
+    if (!enabled()) return result;
+
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result.size += shard.lru.size();
+        result.slots += shard.slots;
+    }
+    return result;
+}
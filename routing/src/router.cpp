@@ -1,94 +1,109 @@
 #include "router.h"
+#include "geo.h"
 #include <cmath>
 #include <limits>
 #include <unordered_map>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <h3/h3api.h>
 
 
 std::vector<int> find_nearest_edge(double lat, double lon,
                                    Direction dir = Direction::BOTH);
 
-
-static double haversine(double lat1, double lon1,
-                        double lat2, double lon2) {
-    constexpr double R = 6371000.0; // meters
-    double dlat = (lat2 - lat1) * M_PI / 180.0;
-    double dlon = (lon2 - lon1) * M_PI / 180.0;
-
-    double a = std::sin(dlat/2)*std::sin(dlat/2) +
-               std::cos(lat1*M_PI/180.0) *
-               std::cos(lat2*M_PI/180.0) *
-               std::sin(dlon/2)*std::sin(dlon/2);
-
-    return 2 * R * std::asin(std::sqrt(a));
+namespace {
+    // Unix seconds, the clock override expiries are given in
+    double unix_now() {
+        using namespace std::chrono;
+        return duration<double>(system_clock::now().time_since_epoch()).count();
+    }
 }
 
-struct Vec2 {
-    double x;
-    double y;
-};
 
-static Vec2 to_xy(double lat, double lon) {
-    constexpr double R = 6371000.0;
-    double x = lon * M_PI / 180.0 * R * std::cos(lat * M_PI / 180.0);
-    double y = lat * M_PI / 180.0 * R;
-    return {x, y};
+RoutingEngine::RoutingEngine(Graph graph)
+    : graph_(std::move(graph)), node_index_(graph_), edge_index_(graph_) {
+    std::vector<double> baseline(graph_.num_edges());
+    EdgeWeights::Snapshot weights = graph_.weights();
+    for (int slot = 0; slot < graph_.num_edges(); ++slot) baseline[slot] = weights[slot];
+    overlay_ = WeightOverlay(std::move(baseline));
 }
 
+RoutingEngine::~RoutingEngine() {
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        stopping_ = true;
+    }
+    expiry_cv_.notify_all();
+    if (expiry_timer_.joinable()) expiry_timer_.join();
+    if (landmark_builder_.joinable()) landmark_builder_.join();
+}
 
+int RoutingEngine::find_nearest_node(double lat, double lon) const {
+    return node_index_.nearest(lat, lon);
+}
 
-double point_to_segment_distance(
-    double plat, double plon,
-    double alat, double alon,
-    double blat, double blon
-) {
-    Vec2 P = to_xy(plat, plon);
-    Vec2 A = to_xy(alat, alon);
-    Vec2 B = to_xy(blat, blon);
-
-    Vec2 AB{B.x - A.x, B.y - A.y};
-    Vec2 AP{P.x - A.x, P.y - A.y};
+std::vector<int> RoutingEngine::nearest_nodes(double lat, double lon, int k) const {
+    return node_index_.k_nearest(lat, lon, k);
+}
 
-    double ab2 = AB.x * AB.x + AB.y * AB.y;
-    if (ab2 == 0.0) {
-        // A and B are the same point
-        double dx = P.x - A.x;
-        double dy = P.y - A.y;
-        return std::sqrt(dx*dx + dy*dy);
-    }
+SearchContext& RoutingEngine::search_context(int slot) const {
+    SearchContext& ctx = SearchContext::local(slot);
+    ctx.set_queue_kind(queue_kind_);
+    return ctx;
+}
 
-    double t = (AP.x * AB.x + AP.y * AB.y) / ab2;
+void RoutingEngine::scan_toward(double lat, double lon,
+                                const std::function<bool(int, double)>& visit) const {
+    int goal = find_nearest_node(lat, lon);
+    if (goal < 0) return;
+    AStar::reverse_dijkstra(graph_, goal, visit, search_context());
+}
 
-    if (t < 0.0) t = 0.0;
-    else if (t > 1.0) t = 1.0;
+std::vector<int> RoutingEngine::isochrone(double lat, double lon, double max_cost,
+                                          bool toward) const {
+    std::vector<int> result;
+    int origin = find_nearest_node(lat, lon);
+    if (origin < 0) return result;
 
-    Vec2 C{
-        A.x + t * AB.x,
-        A.y + t * AB.y
+    auto collect = [&](int node, double cost) {
+        if (cost > max_cost) return false;
+        result.push_back(node);
+        return true;
     };
-
-    double dx = P.x - C.x;
-    double dy = P.y - C.y;
-    return std::sqrt(dx*dx + dy*dy);
+    if (toward) {
+        AStar::reverse_dijkstra(graph_, origin, collect, search_context());
+    } else {
+        AStar::forward_dijkstra(graph_, origin, collect, search_context());
+    }
+    return result;
 }
 
+std::vector<uint64_t> RoutingEngine::isochrone_bitmap(double lat, double lon, double max_cost,
+                                                      bool toward) const {
+    std::vector<uint64_t> bits((graph_.num_nodes() + 63) / 64, 0);
+    for (int node : isochrone(lat, lon, max_cost, toward)) {
+        bits[node / 64] |= uint64_t(1) << (node % 64);
+    }
+    return bits;
+}
 
-RoutingEngine::RoutingEngine(Graph graph)
-    : graph_(std::move(graph)) {}
-
-int RoutingEngine::find_nearest_node(double lat, double lon) const {
-    double best = std::numeric_limits<double>::max();
-    int best_id = -1;
-
-    const auto& nodes = graph_.nodes();
-    for (int i = 0; i < (int)nodes.size(); ++i) {
-        double d = haversine(lat, lon, nodes[i].lat, nodes[i].lon);
-        if (d < best) {
-            best = d;
-            best_id = i;
+std::vector<uint64_t> RoutingEngine::isochrone_cells(double lat, double lon, double max_cost,
+                                                     int resolution, bool toward) const {
+    std::vector<uint64_t> cells;
+    for (int node : isochrone(lat, lon, max_cost, toward)) {
+        LatLng coord = {degsToRads(graph_.get_node_lat(node)),
+                        degsToRads(graph_.get_node_lon(node))};
+        H3Index cell;
+        if (latLngToCell(&coord, resolution, &cell) == E_SUCCESS) {
+            cells.push_back(cell);
         }
     }
-    return best_id;
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    return cells;
 }
 
 bool RoutingEngine::matches_direction(
@@ -127,33 +142,35 @@ bool RoutingEngine::matches_direction(
 
 
 std::vector<int> RoutingEngine::find_nearest_edge(double lat, double lon, Direction dir){
-    std::unordered_map<int, std::vector<int>> table;
+    std::vector<int> result;
 
+    double best = edge_index_.nearest_distance(lat, lon);
+    if (best == std::numeric_limits<double>::infinity()) {
+        return result;
+    }
+
+    // Edges in the same whole-meter bucket as the closest one (both
+    // directions of a two-way street), filtered by travel direction
+    std::vector<std::pair<int, double>> candidates;
+    edge_index_.within(lat, lon, std::floor(best) + 1.0, candidates);
 
-    double best = std::numeric_limits<double>::max();
-    int best_id = -1;
-    std::vector<std::shared_ptr<Edge>>& edges = graph_.edges_mut();
-    const auto& nodes = graph_.nodes();
-    // const auto& nodes = graph_.nodes();
-    for (int i = 0; i < (int)edges.size(); ++i) {
+    for (const auto& [slot, d] : candidates) {
+        if (static_cast<int>(d) != static_cast<int>(best)) continue;
 
-        double d = point_to_segment_distance(lat, lon, nodes[edges[i]->from].lat, nodes[edges[i]->from].lon, nodes[edges[i]->to].lat, nodes[edges[i]->to].lon);
-        if( matches_direction(nodes[edges[i]->from].lat, nodes[edges[i]->from].lon, nodes[edges[i]->to].lat, nodes[edges[i]->to].lon, dir)){
-             table[d].push_back(i);
+        Node a = graph_.node(graph_.edge_source(slot));
+        Node b = graph_.node(graph_.edge_target(slot));
+        if (matches_direction(a.lat, a.lon, b.lat, b.lon, dir)) {
+            result.push_back(slot);
         }
-        if (d <= best) {
-            best = d;
-            best_id = i;
-           
-        }   
     }
-    return table[best];
-
 
+    std::sort(result.begin(), result.end());
+    return result;
 }
 
 double RoutingEngine::route(double lat1, double lon1,
-                            double lat2, double lon2) {
+                            double lat2, double lon2,
+                            SearchMode mode) {
     int start = find_nearest_node(lat1, lon1);
     int goal  = find_nearest_node(lat2, lon2);
 
@@ -162,43 +179,612 @@ double RoutingEngine::route(double lat1, double lon1,
 
     if (start < 0 || goal < 0) return -1.0;
 
-    AStar astar;
-    return astar.shortest_path(graph_, start, goal).total_cost;
+    // Dijkstra stays uncached: it is the reference the other modes are checked against
+    bool cacheable = mode != SearchMode::Dijkstra && route_cache_.enabled();
+    double cost;
+    auto may_improve = [this](int s, int g, double c, int slot) {
+        return may_improve_route(s, g, c, slot);
+    };
+    if (cacheable && route_cache_.lookup(start, goal, cost, may_improve)) {
+        return cost;
+    }
+
+    uint64_t stamp = route_cache_.stamp();
+    AStarResult result = find_path(start, goal, mode, graph_.weights());
+    if (cacheable) {
+        route_cache_.insert(start, goal, result.total_cost, path_slots(result.path), stamp);
+    }
+    return result.total_cost;
 }
 
-void RoutingEngine::update_edge(double lat, double lon, double weight, Direction dir){
-    std::vector<int> closest_edges = find_nearest_edge(lat, lon, dir);
+AStarResult RoutingEngine::find_path(int start, int goal, SearchMode mode,
+                                     const EdgeWeights::Snapshot& weights) {
+    switch (mode) {
+        case SearchMode::CCH:
+            if (customizable_hierarchy_ready()) {
+                apply_customization();
+                std::shared_lock<std::shared_mutex> lock(cch_mutex_);
+                return cch_.shortest_path(start, goal);
+            }
+            [[fallthrough]];
+        case SearchMode::CH:
+            if (hierarchy_ready()) {
+                return ch_.shortest_path(start, goal);
+            }
+            return AStar::shortest_path(graph_, start, goal, weights, search_context());
+        case SearchMode::ALT:
+            return find_path_alt(start, goal, std::numeric_limits<double>::infinity(), weights);
+        case SearchMode::Bidirectional:
+            return AStar::bidirectional(graph_, start, goal, weights,
+                                        search_context(0), search_context(1));
+        case SearchMode::Dijkstra:
+            return AStar::dijkstra(graph_, start, goal, weights, search_context());
+        case SearchMode::AStar:
+        default:
+            return AStar::shortest_path(graph_, start, goal, weights, search_context());
+    }
+}
 
-    for (int e : closest_edges){
-        if (e < 0) return;
-        // std::cout<< e<<"\n";
+AStarResult RoutingEngine::find_path_alt(int start, int goal, double max_cost,
+                                         const EdgeWeights::Snapshot& weights) {
+    // A weight published below the landmark floor while the search ran may
+    // have made the bounds overestimate; if so, search again without them.
+    // Tables swapped in after the staleness check are valid too.
+    uint64_t breaks = landmark_breaks_.load();
+    if (!landmarks_stale_.load()) {
+        std::shared_ptr<const Landmarks> landmarks = std::atomic_load(&landmarks_);
+        if (landmarks && !landmarks->empty()) {
+            AStarResult result = AStar::bounded(graph_, start, goal, max_cost, landmarks.get(),
+                                                weights, search_context());
+            if (landmark_breaks_.load() == breaks) return result;
+        }
+    }
+    return AStar::bounded(graph_, start, goal, max_cost, nullptr, weights, search_context());
+}
 
-        graph_.update_edge_weight(e, weight);
+std::vector<int> RoutingEngine::path_slots(const std::vector<int>& path) const {
+    // Every parallel edge of each hop, so whichever one the cost came from is covered
+    std::vector<int> slots;
+    for (size_t i = 1; i < path.size(); ++i) {
+        for (int e = graph_.edge_begin(path[i - 1]); e < graph_.edge_end(path[i - 1]); ++e) {
+            if (graph_.edge_target(e) == path[i]) slots.push_back(e);
+        }
     }
+    return slots;
+}
 
+void RoutingEngine::enable_route_cache(size_t capacity) {
+    route_cache_.reset(capacity);
 }
 
-void RoutingEngine::update_edge(int id, double weight){
-    if (id >= graph_.edges_mut().size() || id < 0){
+double RoutingEngine::lower_bound(int from, int to) const {
+    if (landmarks_ready()) {
+        std::shared_ptr<const Landmarks> landmarks = std::atomic_load(&landmarks_);
+        if (landmarks && !landmarks->empty()) return landmarks->lower_bound(from, to);
+    }
+    double max_speed = graph_.max_speed();
+    if (max_speed <= 0.0) return 0.0;
+    return haversine(graph_.get_node_lat(from), graph_.get_node_lon(from),
+                     graph_.get_node_lat(to), graph_.get_node_lon(to)) / max_speed;
+}
+
+bool RoutingEngine::may_improve_route(int start, int goal, double cost, int slot) const {
+    // Landmark tables that went stale meanwhile may have overestimated
+    uint64_t breaks = landmark_breaks_.load();
+    double through = lower_bound(start, graph_.edge_source(slot)) + graph_.edge_weight(slot) +
+                     lower_bound(graph_.edge_target(slot), goal);
+    return through < cost || landmark_breaks_.load() != breaks;
+}
+
+int RoutingEngine::hop_slot(int from, int to, const EdgeWeights::Snapshot& weights) const {
+    int best = -1;
+    for (int e = graph_.edge_begin(from); e < graph_.edge_end(from); ++e) {
+        if (graph_.edge_target(e) == to && (best < 0 || weights[e] < weights[best])) {
+            best = e;
+        }
+    }
+    return best;
+}
+
+double RoutingEngine::hop_cost(int from, int to, const EdgeWeights::Snapshot& weights) const {
+    int slot = hop_slot(from, to, weights);
+    return slot < 0 ? std::numeric_limits<double>::infinity() : weights[slot];
+}
+
+void RoutingEngine::path_geometry(const std::vector<int>& path,
+                                  const EdgeWeights::Snapshot& weights,
+                                  std::vector<double>& lats, std::vector<double>& lons) const {
+    lats.clear();
+    lons.clear();
+    std::vector<std::pair<double, double>> shape;
+    for (size_t i = 0; i < path.size(); ++i) {
+        if (i > 0) {
+            int slot = hop_slot(path[i - 1], path[i], weights);
+            if (slot >= 0) {
+                graph_.edge_shape(slot, shape);
+                for (const auto& [lat, lon] : shape) {
+                    lats.push_back(lat);
+                    lons.push_back(lon);
+                }
+            }
+        }
+        lats.push_back(graph_.get_node_lat(path[i]));
+        lons.push_back(graph_.get_node_lon(path[i]));
+    }
+}
+
+int RoutingEngine::route_path(double lat1, double lon1, double lat2, double lon2,
+                              int* nodes, double* lats, double* lons, double* edge_costs,
+                              int capacity, double* total_cost, SearchMode mode) {
+    int start = find_nearest_node(lat1, lon1);
+    int goal  = find_nearest_node(lat2, lon2);
+    if (start < 0 || goal < 0) return -1;
+
+    // One pinned version for the search and the hop costs. The hierarchies
+    // search their own customized metric, so the total is summed from the
+    // hops; for the graph searches that is exactly the cost they found.
+    EdgeWeights::Snapshot weights = graph_.weights();
+    AStarResult result = find_path(start, goal, mode, weights);
+
+    const std::vector<int>& path = result.path;
+    int n = static_cast<int>(path.size());
+    int fill = std::min(n, std::max(capacity, 0));
+    double total = n > 0 ? 0.0 : result.total_cost;
+    for (int i = 0; i < n; ++i) {
+        double hop = i + 1 < n ? hop_cost(path[i], path[i + 1], weights) : 0.0;
+        total += hop;
+        if (i >= fill) continue;
+        if (nodes) nodes[i] = path[i];
+        if (lats) lats[i] = graph_.get_node_lat(path[i]);
+        if (lons) lons[i] = graph_.get_node_lon(path[i]);
+        if (edge_costs && i + 1 < n) edge_costs[i] = hop;
+    }
+    if (total_cost) *total_cost = total;
+    return n;
+}
+
+int RoutingEngine::route_geometry(double lat1, double lon1, double lat2, double lon2,
+                                  double* lats, double* lons, int capacity, SearchMode mode) {
+    int start = find_nearest_node(lat1, lon1);
+    int goal  = find_nearest_node(lat2, lon2);
+    if (start < 0 || goal < 0) return -1;
+
+    EdgeWeights::Snapshot weights = graph_.weights();
+    AStarResult result = find_path(start, goal, mode, weights);
+    std::vector<double> path_lats, path_lons;
+    path_geometry(result.path, weights, path_lats, path_lons);
+
+    int n = static_cast<int>(path_lats.size());
+    int fill = std::min(n, std::max(capacity, 0));
+    if (lats) std::copy(path_lats.begin(), path_lats.begin() + fill, lats);
+    if (lons) std::copy(path_lons.begin(), path_lons.begin() + fill, lons);
+    return n;
+}
+
+int RoutingEngine::route_polyline(double lat1, double lon1, double lat2, double lon2,
+                                  char* out, int capacity, SearchMode mode) {
+    int start = find_nearest_node(lat1, lon1);
+    int goal  = find_nearest_node(lat2, lon2);
+    if (start < 0 || goal < 0) return -1;
+
+    EdgeWeights::Snapshot weights = graph_.weights();
+    AStarResult result = find_path(start, goal, mode, weights);
+
+    // An unreachable goal leaves the path empty, which encodes as ""
+    std::vector<double> lats, lons;
+    path_geometry(result.path, weights, lats, lons);
+    return static_cast<int>(encode_polyline(lats.data(), lons.data(), lats.size(),
+                                            out, std::max(capacity, 0)));
+}
+
+double RoutingEngine::route_within(double lat1, double lon1,
+                                   double lat2, double lon2, double max_cost) {
+    int start = find_nearest_node(lat1, lon1);
+    int goal  = find_nearest_node(lat2, lon2);
+    if (start < 0 || goal < 0) return -1.0;
+
+    return find_path_alt(start, goal, max_cost, graph_.weights()).total_cost;
+}
+
+std::vector<double> RoutingEngine::route_matrix(
+    const std::vector<std::pair<double, double>>& sources,
+    const std::vector<std::pair<double, double>>& targets) {
+    size_t S = sources.size(), T = targets.size();
+    std::vector<double> result(S * T, -1.0);
+
+    // Snap once per point; only snapped points take part in the search
+    std::vector<int> src_nodes, dst_nodes, src_rows, dst_cols;
+    for (size_t i = 0; i < S; ++i) {
+        int node = find_nearest_node(sources[i].first, sources[i].second);
+        if (node < 0) continue;
+        src_nodes.push_back(node);
+        src_rows.push_back(static_cast<int>(i));
+    }
+    for (size_t j = 0; j < T; ++j) {
+        int node = find_nearest_node(targets[j].first, targets[j].second);
+        if (node < 0) continue;
+        dst_nodes.push_back(node);
+        dst_cols.push_back(static_cast<int>(j));
+    }
+    if (src_nodes.empty() || dst_nodes.empty()) return result;
+
+    std::vector<double> costs(src_nodes.size() * dst_nodes.size());
+    if (customizable_hierarchy_ready()) {
+        apply_customization();
+        std::shared_lock<std::shared_mutex> lock(cch_mutex_);
+        cch_.many_to_many(src_nodes, dst_nodes, costs.data());
+    } else {
+        for (size_t i = 0; i < src_nodes.size(); ++i) {
+            AStar::one_to_many(graph_, src_nodes[i], dst_nodes,
+                               costs.data() + i * dst_nodes.size(), search_context());
+        }
+    }
+
+    for (size_t i = 0; i < src_rows.size(); ++i) {
+        for (size_t j = 0; j < dst_cols.size(); ++j) {
+            result[src_rows[i] * T + dst_cols[j]] = costs[i * dst_nodes.size() + j];
+        }
+    }
+    return result;
+}
+
+bool RoutingEngine::prepare_hierarchy(const std::string& cache_file) {
+    if (hierarchy_ready()) return true;
+
+    uint64_t fingerprint = graph_.fingerprint();
+    if (!cache_file.empty() && ch_.load(cache_file, fingerprint)) {
+        ch_stale_ = false;
+        return true;
+    }
+
+    ch_ = ContractionHierarchy(graph_);
+    ch_stale_ = false;
+
+    if (!cache_file.empty()) {
+        ch_.save(cache_file, fingerprint);
+    }
+    return !ch_.empty();
+}
+
+bool RoutingEngine::prepare_customizable_hierarchy(int num_threads) {
+    if (customizable_hierarchy_ready()) return true;
+
+    cch_ = CustomizableCH(graph_, num_threads);
+    cch_pending_.clear();
+    cch_dirty_ = false;
+    return !cch_.empty();
+}
+
+bool RoutingEngine::prepare_landmarks(int count) {
+    if (landmarks_ready()) return true;
+    if (landmark_builder_.joinable()) landmark_builder_.join();
+
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        landmark_count_ = count;
+        landmarks_building_ = true;
+    }
+    build_landmarks();
+    return landmarks_ready();
+}
+
+void RoutingEngine::build_landmarks() {
+    while (true) {
+        // Lower the floor to the current weights, so every weight that is
+        // published from here on and stays above it keeps the tables valid
+        std::vector<double> floor;
+        uint64_t breaks;
+        {
+            std::lock_guard<std::mutex> lock(update_mutex_);
+            EdgeWeights::Snapshot current = graph_.weights();
+            if (landmark_floor_.empty()) {
+                landmark_floor_.resize(graph_.num_edges());
+                for (int slot = 0; slot < graph_.num_edges(); ++slot) {
+                    landmark_floor_[slot] = std::min(overlay_.baseline(slot), current[slot]);
+                }
+            } else {
+                for (int slot = 0; slot < graph_.num_edges(); ++slot) {
+                    landmark_floor_[slot] = std::min(landmark_floor_[slot], current[slot]);
+                }
+            }
+            floor = landmark_floor_;
+            breaks = landmark_breaks_.load();
+        }
+
+        auto tables = std::make_shared<const Landmarks>(graph_, floor, landmark_count_);
+
+        // A weight went below the new floor while the tables were built
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        if (landmark_breaks_.load() != breaks) continue;
+        std::atomic_store(&landmarks_, std::shared_ptr<const Landmarks>(std::move(tables)));
+        landmarks_stale_ = false;
+        landmarks_building_ = false;
         return;
+    }
+}
+
+void RoutingEngine::rebuild_landmarks() {
+    // Called under update_mutex_; a builder that already finished has
+    // released it for good, so joining cannot block on us
+    if (landmark_count_ == 0 || landmarks_building_) return;
+    landmarks_building_ = true;
+    if (landmark_builder_.joinable()) landmark_builder_.join();
+    landmark_builder_ = std::thread([this] { build_landmarks(); });
+}
+
+void RoutingEngine::apply_customization() {
+    if (!cch_dirty_.load()) return;
+
+    // Queries already past this point finish on the old metric first
+    std::unique_lock<std::shared_mutex> lock(cch_mutex_);
+    std::vector<int> slots;
+    {
+        std::lock_guard<std::mutex> pending(cch_pending_mutex_);
+        slots.swap(cch_pending_);
+        cch_dirty_ = false;
+    }
+    if (!slots.empty()) cch_.customize(graph_, slots);
+}
 
+void RoutingEngine::publish_weights(const std::vector<std::pair<int, double>>& updates) {
+    if (updates.empty()) return;
+
+    bool below_floor = false;
+    std::vector<int> increased, decreased;
+    {
+        EdgeWeights::Snapshot old = graph_.weights();
+        for (const auto& [slot, weight] : updates) {
+            if (weight < old[slot]) decreased.push_back(slot);
+            else if (weight > old[slot]) increased.push_back(slot);
+            if (!landmark_floor_.empty() && EdgeWeights::round(weight) < landmark_floor_[slot]) {
+                below_floor = true;
+            }
+        }
+    }
+
+    // Derived data is marked stale before the new weights are published and
+    // the changes are logged for the route cache after, so no reader pairs
+    // new weights with old landmarks or keeps a route the change affects
+    if (below_floor) {
+        landmark_breaks_.fetch_add(1);
+        landmarks_stale_ = true;
     }
+    ch_stale_ = true;
 
-    graph_.update_edge_weight(id, weight);
+    graph_.set_edge_weights(updates);
+    if (!cch_.empty()) {
+        std::lock_guard<std::mutex> pending(cch_pending_mutex_);
+        for (const auto& update : updates) cch_pending_.push_back(update.first);
+        cch_dirty_ = true;
+    }
+
+    route_cache_.record(increased, decreased);
 
+    if (below_floor) rebuild_landmarks();
 }
 
-void RoutingEngine::update_edge(int from, int to, double weight){
-    std::vector<std::shared_ptr<Edge>>& edges = graph_.edges_mut();
+void RoutingEngine::publish_effective(std::vector<int>& touched) {
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    std::vector<std::pair<int, double>> updates;
+    {
+        EdgeWeights::Snapshot current = graph_.weights();
+        for (int slot : touched) {
+            double weight = overlay_.effective(slot);
+            if (EdgeWeights::round(weight) != current[slot]) updates.emplace_back(slot, weight);
+        }
+    }
+    publish_weights(updates);
+}
+
+void RoutingEngine::apply_overrides(OverrideLayer layer,
+                                    const std::vector<std::pair<int, double>>& set,
+                                    const std::vector<int>& cleared, double expires) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    std::vector<int> touched;
+    for (int slot : cleared) overlay_.clear(layer, slot, touched);
+    for (const auto& [slot, weight] : set) overlay_.set(layer, slot, weight, expires, touched);
+    publish_effective(touched);
+    if (expires > 0.0) schedule_expiry();
+}
+
+int RoutingEngine::set_overrides(OverrideLayer layer, const int* ids, const double* weights,
+                                 int count, double expires) {
+    std::vector<std::pair<int, double>> set;
+    for (int i = 0; i < count; ++i) {
+        int slot = graph_.slot_of_id(ids[i]);
+        if (slot >= 0) set.emplace_back(slot, weights[i]);
+    }
+    apply_overrides(layer, set, {}, expires);
+    return static_cast<int>(set.size());
+}
+
+int RoutingEngine::clear_overrides(OverrideLayer layer, const int* ids, int count) {
+    std::vector<int> cleared;
+    for (int i = 0; i < count; ++i) {
+        int slot = graph_.slot_of_id(ids[i]);
+        if (slot >= 0) cleared.push_back(slot);
+    }
+    apply_overrides(layer, {}, cleared);
+    return static_cast<int>(cleared.size());
+}
+
+std::vector<int> RoutingEngine::slots_in_radius(double lat, double lon, double radius_m) const {
+    std::vector<std::pair<int, double>> found;
+    edge_index_.within(lat, lon, radius_m, found);
+
+    std::vector<int> slots;
+    slots.reserve(found.size());
+    for (const auto& entry : found) slots.push_back(entry.first);
+    return slots;
+}
+
+int RoutingEngine::set_area_overrides(OverrideLayer layer, const std::vector<int>& slots,
+                                      double value, bool scale, double expires) {
+    std::vector<std::pair<int, double>> set;
+    set.reserve(slots.size());
+    for (int slot : slots) {
+        set.emplace_back(slot, scale ? overlay_.baseline(slot) * value : value);
+    }
+    apply_overrides(layer, set, {}, expires);
+    return static_cast<int>(set.size());
+}
+
+int RoutingEngine::set_overrides_in_radius(OverrideLayer layer, double lat, double lon,
+                                           double radius_m, double weight, double expires) {
+    return set_area_overrides(layer, slots_in_radius(lat, lon, radius_m), weight, false, expires);
+}
+
+int RoutingEngine::scale_overrides_in_radius(OverrideLayer layer, double lat, double lon,
+                                             double radius_m, double factor, double expires) {
+    return set_area_overrides(layer, slots_in_radius(lat, lon, radius_m), factor, true, expires);
+}
+
+int RoutingEngine::clear_overrides_in_radius(OverrideLayer layer, double lat, double lon,
+                                             double radius_m) {
+    std::vector<int> slots = slots_in_radius(lat, lon, radius_m);
+    apply_overrides(layer, {}, slots);
+    return static_cast<int>(slots.size());
+}
+
+int RoutingEngine::set_overrides_in_polygon(OverrideLayer layer,
+                                            const std::vector<std::pair<double, double>>& polygon,
+                                            double weight, double expires) {
+    std::vector<int> slots;
+    edge_index_.in_polygon(polygon, slots);
+    return set_area_overrides(layer, slots, weight, false, expires);
+}
+
+int RoutingEngine::scale_overrides_in_polygon(OverrideLayer layer,
+                                              const std::vector<std::pair<double, double>>& polygon,
+                                              double factor, double expires) {
+    std::vector<int> slots;
+    edge_index_.in_polygon(polygon, slots);
+    return set_area_overrides(layer, slots, factor, true, expires);
+}
+
+int RoutingEngine::clear_overrides_in_polygon(OverrideLayer layer,
+                                              const std::vector<std::pair<double, double>>& polygon) {
+    std::vector<int> slots;
+    edge_index_.in_polygon(polygon, slots);
+    apply_overrides(layer, {}, slots);
+    return static_cast<int>(slots.size());
+}
 
-    for (auto& e : edges){
-        if (to == e->to && from == e->from){
-            // std::cout<< e->id<<"\n";
-            graph_.update_edge_weight(e->id, weight);
-            return;
+int RoutingEngine::clear_layer(OverrideLayer layer) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    std::vector<int> touched;
+    overlay_.clear(layer, touched);
+    int cleared = static_cast<int>(touched.size());
+    publish_effective(touched);
+    return cleared;
+}
+
+int RoutingEngine::expire_overrides(double now) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    std::vector<int> touched;
+    overlay_.expire(now, touched);
+    int expired = static_cast<int>(touched.size());
+    publish_effective(touched);
+    return expired;
+}
+
+void RoutingEngine::schedule_expiry() {
+    // Called under update_mutex_
+    if (overlay_.next_expiry() == std::numeric_limits<double>::infinity()) return;
+    if (expiry_timer_.joinable()) {
+        expiry_cv_.notify_all();   // the new expiry may be the earliest
+    } else {
+        expiry_timer_ = std::thread([this] { run_expiry_timer(); });
+    }
+}
+
+void RoutingEngine::run_expiry_timer() {
+    std::unique_lock<std::mutex> lock(update_mutex_);
+    while (!stopping_) {
+        double next = overlay_.next_expiry();
+        double now = unix_now();
+        if (next <= now) {
+            std::vector<int> touched;
+            overlay_.expire(now, touched);
+            publish_effective(touched);
+        } else if (next == std::numeric_limits<double>::infinity()) {
+            expiry_cv_.wait(lock);
+        } else {
+            expiry_cv_.wait_for(lock, std::chrono::duration<double>(next - now));
         }
     }
 }
 
+bool RoutingEngine::save_overrides(const std::string& path) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    return overlay_.save(path);
+}
+
+bool RoutingEngine::load_overrides(const std::string& path) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    std::vector<int> touched;
+    if (!overlay_.load(path, touched)) return false;
+    publish_effective(touched);
+    schedule_expiry();
+    return true;
+}
+
+void RoutingEngine::update_edge(double lat, double lon, double weight, Direction dir){
+    std::vector<std::pair<int, double>> updates;
+    for (int slot : find_nearest_edge(lat, lon, dir)) {
+        updates.emplace_back(slot, weight);
+    }
+    apply_overrides(OverrideLayer::Manual, updates);
+}
+
+void RoutingEngine::update_edge(int id, double weight){
+    int slot = graph_.slot_of_id(id);
+    if (slot < 0) return;
+
+    apply_overrides(OverrideLayer::Manual, {{slot, weight}});
+}
+
+void RoutingEngine::update_edge(int from, int to, double weight){
+    int slot = graph_.slot_of(from, to);
+    if (slot >= 0) {
+        apply_overrides(OverrideLayer::Manual, {{slot, weight}});
+    }
+}
+
+int RoutingEngine::update_edges(const int* ids, const double* weights, int count) {
+    std::vector<std::pair<int, double>> updates;
+    updates.reserve(std::max(count, 0));
+    for (int i = 0; i < count; ++i) {
+        int slot = graph_.slot_of_id(ids[i]);
+        if (slot >= 0) updates.emplace_back(slot, weights[i]);
+    }
+    apply_overrides(OverrideLayer::Manual, updates);
+    return static_cast<int>(updates.size());
+}
 
+int RoutingEngine::update_edges(const int* from, const int* to, const double* weights,
+                                int count) {
+    std::vector<std::pair<int, double>> updates;
+    updates.reserve(std::max(count, 0));
+    for (int i = 0; i < count; ++i) {
+        int slot = graph_.slot_of(from[i], to[i]);
+        if (slot >= 0) updates.emplace_back(slot, weights[i]);
+    }
+    apply_overrides(OverrideLayer::Manual, updates);
+    return static_cast<int>(updates.size());
+}
 
+bool RoutingEngine::enqueue_update(int id, double weight) {
+    int slot = graph_.slot_of_id(id);
+    return slot >= 0 && update_queue_.push(slot, weight);
+}
+
+int RoutingEngine::flush_updates() {
+    std::lock_guard<std::mutex> lock(flush_mutex_);
+    std::vector<std::pair<int, double>> updates;
+    update_queue_.drain(updates);
+    apply_overrides(OverrideLayer::Manual, updates);
+    return static_cast<int>(updates.size());
+}
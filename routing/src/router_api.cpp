@@ -1,25 +1,29 @@
 #include "router.h"
 #include "osm_parser.h"
 #include "graphbuilder.h"
-
-#include <osmium/io/any_input.hpp>
-#include <osmium/visitor.hpp>
+#include "traffic.h"
 
 #include <memory>
 #include <mutex>
 #include <limits>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <cstdint>
 
 namespace {
     std::unique_ptr<RoutingEngine> engine;
+    std::unique_ptr<TrafficModel> traffic;   // declared after engine: stops first
     std::once_flag init_flag;
+
+    constexpr size_t ROUTE_CACHE_SLOTS = 1 << 22;     // path edge slots, about 16 MB
+    constexpr double TRAFFIC_FLUSH_INTERVAL = 30.0;   // seconds
 }
 
 extern "C" {
 
-#include <string>
-#include <unordered_map>
-#include <algorithm>
-
 static Direction parse_direction(const std::string& input) {
     static const std::unordered_map<std::string, Direction> map = {
         {"N",  Direction::N},
@@ -51,32 +55,28 @@ bool init_router(const char* osm_file) {
 
     std::call_once(init_flag, [&]() {
         try {
-            // 1. Parse OSM
-            OSMHandler handler;
-            osmium::io::Reader reader(osm_file);
-            osmium::apply(reader, handler);
-            reader.close();
+            // 1. Load the cached graph snapshot, or parse OSM and build it
+            Graph graph = GraphBuilder::load_or_build(osm_file);
 
-            if (handler.nodes.empty() || handler.ways.empty()) {
+            if (graph.num_nodes() == 0) {
                 success = false;
                 return;
             }
 
-            // 2. Build graph
-            GraphBuilder builder(
-                std::move(handler.nodes),
-                std::move(handler.ways)
-            );
+            // 2. Create routing engine
+            engine = std::make_unique<RoutingEngine>(std::move(graph));
 
-            Graph graph = builder.build_graph();
+            // 3. Customizable hierarchy, which stays exact across edge updates;
+            // every route query here uses it, so the static contraction
+            // hierarchy (stale after the first update) is not prepared
+            engine->prepare_customizable_hierarchy();
 
-            if (graph.nodes().empty()) {
-                success = false;
-                return;
-            }
+            // 4. Route cost cache for repeated snapped pairs
+            engine->enable_route_cache(ROUTE_CACHE_SLOTS);
 
-            // 3. Create routing engine
-            engine = std::make_unique<RoutingEngine>(std::move(graph));
+            // 5. Traffic model over the free-flow weights, flushed periodically
+            traffic = std::make_unique<TrafficModel>(*engine);
+            traffic->start(TRAFFIC_FLUSH_INTERVAL);
         }
         catch (...) {
             success = false;
@@ -92,7 +92,117 @@ double route_distance(double lat1, double lon1,
         return std::numeric_limits<double>::infinity();
     }
 
-    return engine->route(lat1, lon1, lat2, lon2);
+    return engine->route(lat1, lon1, lat2, lon2, SearchMode::CCH);
+}
+
+// Path of the route into caller buffers of `capacity` entries (any may be
+// null): node indices, coordinates and per-hop costs (edge_costs[i] is the
+// hop from node i to i + 1). Returns the number of path nodes, possibly more
+// than capacity; 0 if unreachable, -1 on snapping failure or no engine.
+int route_path(double lat1, double lon1, double lat2, double lon2,
+               int* nodes, double* lats, double* lons, double* edge_costs,
+               int capacity, double* total_cost) {
+    if (!engine) {
+        return -1;
+    }
+
+    return engine->route_path(lat1, lon1, lat2, lon2, nodes, lats, lons, edge_costs,
+                              capacity, total_cost, SearchMode::CCH);
+}
+
+// Road geometry of the route (nodes and shape points) into caller buffers.
+// Returns the number of points, possibly more than capacity; 0 if
+// unreachable, -1 on snapping failure or no engine.
+int route_geometry(double lat1, double lon1, double lat2, double lon2,
+                   double* lats, double* lons, int capacity) {
+    if (!engine) {
+        return -1;
+    }
+
+    return engine->route_geometry(lat1, lon1, lat2, lon2, lats, lons, capacity,
+                                  SearchMode::CCH);
+}
+
+// Encoded polyline of the route's road geometry, NUL-terminated in out.
+// Returns the full length (retry with a larger buffer if it is >=
+// capacity); 0 if unreachable, -1 on snapping failure or no engine.
+int route_polyline(double lat1, double lon1, double lat2, double lon2,
+                   char* out, int capacity) {
+    if (!engine) {
+        return -1;
+    }
+
+    return engine->route_polyline(lat1, lon1, lat2, lon2, out, capacity, SearchMode::CCH);
+}
+
+// Route cache counters: hits, misses, invalidated entries, current size
+void route_cache_stats(uint64_t* hits, uint64_t* misses,
+                       uint64_t* invalidations, uint64_t* size) {
+    RouteCache::Stats stats{0, 0, 0, 0, 0};
+    if (engine) {
+        stats = engine->route_cache_stats();
+    }
+
+    if (hits) *hits = stats.hits;
+    if (misses) *misses = stats.misses;
+    if (invalidations) *invalidations = stats.invalidations;
+    if (size) *size = stats.size;
+}
+
+// Cost of the route if it is at most max_cost; infinity when it is beyond
+// the limit (or unreachable), -1 if a point cannot be snapped.
+double route_within(double lat1, double lon1,
+                    double lat2, double lon2, double max_cost) {
+    if (!engine) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    return engine->route_within(lat1, lon1, lat2, lon2, max_cost);
+}
+
+// Graph nodes reachable from a point within max_cost, cheapest first. Writes
+// up to capacity of them and returns how many there are in total.
+int isochrone_nodes(double lat, double lon, double max_cost, int* out, int capacity) {
+    if (!engine) {
+        return 0;
+    }
+
+    std::vector<int> nodes = engine->isochrone(lat, lon, max_cost);
+    int n = std::min(static_cast<int>(nodes.size()), std::max(capacity, 0));
+    if (out) std::copy(nodes.begin(), nodes.begin() + n, out);
+    return static_cast<int>(nodes.size());
+}
+
+// H3 cells at the given resolution covering the same set, sorted; same
+// capacity contract as isochrone_nodes
+int isochrone_cells(double lat, double lon, double max_cost, int resolution,
+                    uint64_t* out, int capacity) {
+    if (!engine) {
+        return 0;
+    }
+
+    std::vector<uint64_t> cells = engine->isochrone_cells(lat, lon, max_cost, resolution);
+    int n = std::min(static_cast<int>(cells.size()), std::max(capacity, 0));
+    if (out) std::copy(cells.begin(), cells.begin() + n, out);
+    return static_cast<int>(cells.size());
+}
+
+// Dense row-major travel-time matrix: out[i * num_targets + j] is the cost
+// from source i to target j (-1 if either point cannot be snapped).
+bool route_matrix(const double* src_lats, const double* src_lons, int num_sources,
+                  const double* dst_lats, const double* dst_lons, int num_targets,
+                  double* out) {
+    if (!engine || num_sources < 0 || num_targets < 0 || !out) {
+        return false;
+    }
+
+    std::vector<std::pair<double, double>> sources(num_sources), targets(num_targets);
+    for (int i = 0; i < num_sources; ++i) sources[i] = {src_lats[i], src_lons[i]};
+    for (int j = 0; j < num_targets; ++j) targets[j] = {dst_lats[j], dst_lons[j]};
+
+    std::vector<double> costs = engine->route_matrix(sources, targets);
+    std::copy(costs.begin(), costs.end(), out);
+    return true;
 }
 
 void update_edge_by_coordinates(double lat,
@@ -130,6 +240,176 @@ void update_edge_by_nodes(int from, int to, double weight) {
     engine->update_edge(from, to, weight);
 }
 
+// Batched updates, applied as one atomic step so routes never see part of a
+// batch. Unknown edges are skipped; returns the number applied.
+int update_edges_by_id(const int* ids, const double* weights, int count) {
+    if (!engine || !ids || !weights) {
+        return 0;
+    }
+    return engine->update_edges(ids, weights, count);
+}
+
+int update_edges_by_nodes(const int* from, const int* to, const double* weights, int count) {
+    if (!engine || !from || !to || !weights) {
+        return 0;
+    }
+    return engine->update_edges(from, to, weights, count);
+}
+
+// Queue one update without blocking, for a feed thread; false if the edge is
+// unknown or the queue is full (flush, then retry)
+bool enqueue_edge_update(int id, double weight) {
+    if (!engine) {
+        return false;
+    }
+    return engine->enqueue_update(id, weight);
+}
+
+// Apply everything queued so far as one batch; returns how many updates
+int flush_edge_updates() {
+    if (!engine) {
+        return 0;
+    }
+    return engine->flush_updates();
+}
+
+// Override layers: 0 traffic, 1 incident, 2 manual (highest precedence).
+// update_edge_* calls write the manual layer.
+static bool parse_layer(int layer, OverrideLayer& out) {
+    if (layer < 0 || layer >= WeightOverlay::NUM_LAYERS) return false;
+    out = static_cast<OverrideLayer>(layer);
+    return true;
+}
+
+// Override edges in one layer until expires (Unix seconds, 0 for never);
+// returns the number applied
+int set_edge_overrides(int layer, const int* ids, const double* weights, int count,
+                       double expires) {
+    OverrideLayer l;
+    if (!engine || !ids || !weights || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->set_overrides(l, ids, weights, count, expires);
+}
+
+// Remove overrides of edges in one layer, uncovering the layers beneath
+int clear_edge_overrides(int layer, const int* ids, int count) {
+    OverrideLayer l;
+    if (!engine || !ids || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->clear_overrides(l, ids, count);
+}
+
+// Remove a whole layer; returns how many overrides it held
+int clear_override_layer(int layer) {
+    OverrideLayer l;
+    if (!engine || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->clear_layer(l);
+}
+
+// Area overrides in one layer: every edge with some part inside a circle
+// (radius in metres) or a polygon given as n vertex latitudes / longitudes.
+// set_* overrides with weight (infinity closes the edges), scale_* with the
+// baseline weight times factor. Return the number of edges.
+int set_edge_overrides_in_radius(int layer, double lat, double lon, double radius_m,
+                                 double weight, double expires) {
+    OverrideLayer l;
+    if (!engine || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->set_overrides_in_radius(l, lat, lon, radius_m, weight, expires);
+}
+
+int scale_edge_overrides_in_radius(int layer, double lat, double lon, double radius_m,
+                                   double factor, double expires) {
+    OverrideLayer l;
+    if (!engine || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->scale_overrides_in_radius(l, lat, lon, radius_m, factor, expires);
+}
+
+int clear_edge_overrides_in_radius(int layer, double lat, double lon, double radius_m) {
+    OverrideLayer l;
+    if (!engine || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->clear_overrides_in_radius(l, lat, lon, radius_m);
+}
+
+static std::vector<std::pair<double, double>> make_polygon(const double* lats,
+                                                           const double* lons, int n) {
+    std::vector<std::pair<double, double>> polygon;
+    for (int i = 0; i < n; ++i) polygon.emplace_back(lats[i], lons[i]);
+    return polygon;
+}
+
+int set_edge_overrides_in_polygon(int layer, const double* lats, const double* lons, int n,
+                                  double weight, double expires) {
+    OverrideLayer l;
+    if (!engine || !lats || !lons || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->set_overrides_in_polygon(l, make_polygon(lats, lons, n), weight, expires);
+}
+
+int scale_edge_overrides_in_polygon(int layer, const double* lats, const double* lons, int n,
+                                    double factor, double expires) {
+    OverrideLayer l;
+    if (!engine || !lats || !lons || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->scale_overrides_in_polygon(l, make_polygon(lats, lons, n), factor, expires);
+}
+
+int clear_edge_overrides_in_polygon(int layer, const double* lats, const double* lons, int n) {
+    OverrideLayer l;
+    if (!engine || !lats || !lons || !parse_layer(layer, l)) {
+        return 0;
+    }
+    return engine->clear_overrides_in_polygon(l, make_polygon(lats, lons, n));
+}
+
+// Original weight of an edge before any override, -1 if unknown
+double edge_baseline_weight(int id) {
+    if (!engine) {
+        return -1.0;
+    }
+    int slot = engine->graph().slot_of_id(id);
+    return slot < 0 ? -1.0 : engine->baseline_weight(slot);
+}
+
+bool save_overrides(const char* path) {
+    return engine && path && engine->save_overrides(path);
+}
+
+bool load_overrides(const char* path) {
+    return engine && path && engine->load_overrides(path);
+}
+
+// Probe speeds (m/s) on edges by id, at Unix times in seconds. They are
+// smoothed per edge and reach routing at the next traffic flush. Returns the
+// number accepted.
+int observe_speeds(const int* edge_ids, const double* speeds, const double* times,
+                   int count) {
+    if (!traffic || !edge_ids || !speeds || !times) {
+        return 0;
+    }
+    return traffic->observe(edge_ids, speeds, times, count);
+}
+
+// Flush traffic now instead of waiting for the timer; returns the number of
+// edges whose weight changed
+int flush_traffic() {
+    if (!traffic) {
+        return 0;
+    }
+    return traffic->flush(TrafficModel::now());
+}
+
 
 }
 
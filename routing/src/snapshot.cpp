@@ -0,0 +1,156 @@
+#include "snapshot.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char MAGIC[8] = {'R', 'T', 'S', 'N', 'A', 'P', 0, 2};
+constexpr uint32_t ORDER_MARK = 0x01020304;   // reads 0x04030201 on the other byte order
+constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t kind;
+    uint32_t version;
+    uint32_t order_mark;
+    uint32_t reserved;
+    uint64_t source_hash;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+struct SectionHeader {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+size_t padded(size_t n) { return (n + 7) & ~size_t(7); }
+
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t h = seed;
+
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t w;
+        std::memcpy(&w, p + i * 8, 8);
+        h ^= w;
+        h *= FNV_PRIME;
+    }
+    for (size_t i = words * 8; i < size; ++i) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+uint64_t hash_file(const std::string& path) {
+    MappedFile file(path);
+    if (!file.valid()) return 0;
+    return hash_bytes(file.data(), file.size());
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            data_ = static_cast<const uint8_t*>(p);
+            size_ = static_cast<size_t>(st.st_size);
+        }
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        ::munmap(const_cast<uint8_t*>(data_), size_);
+    }
+}
+
+void SnapshotWriter::add_raw(uint32_t tag, const void* data, size_t size) {
+    SectionHeader sh{tag, 0, size};
+    size_t at = payload_.size();
+    payload_.resize(at + sizeof(sh) + padded(size), 0);
+    std::memcpy(payload_.data() + at, &sh, sizeof(sh));
+    if (size > 0) {
+        std::memcpy(payload_.data() + at + sizeof(sh), data, size);
+    }
+}
+
+bool SnapshotWriter::write(const std::string& path) const {
+    SnapshotHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.kind = kind_;
+    header.version = version_;
+    header.order_mark = ORDER_MARK;
+    header.reserved = 0;
+    header.source_hash = source_hash_;
+    header.payload_size = payload_.size();
+    header.checksum = hash_bytes(payload_.data(), payload_.size());
+
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1 &&
+              std::fwrite(payload_.data(), 1, payload_.size(), f) == payload_.size();
+    ok = (std::fclose(f) == 0) && ok;
+
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+SnapshotReader::SnapshotReader(const std::string& path, uint32_t kind, uint32_t version, uint64_t source_hash)
+    : file_(path) {
+    if (!file_.valid() || file_.size() < sizeof(SnapshotHeader)) return;
+
+    SnapshotHeader header;
+    std::memcpy(&header, file_.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return;
+    if (header.order_mark != ORDER_MARK) return;
+    if (header.kind != kind || header.version != version) return;
+    if (header.source_hash != source_hash) return;
+    if (header.payload_size != file_.size() - sizeof(SnapshotHeader)) return;
+
+    const uint8_t* payload = file_.data() + sizeof(SnapshotHeader);
+    if (hash_bytes(payload, header.payload_size) != header.checksum) return;
+
+    valid_ = true;
+}
+
+bool SnapshotReader::section(uint32_t tag, const uint8_t*& data, size_t& size) const {
+    if (!valid_) return false;
+
+    const uint8_t* p = file_.data() + sizeof(SnapshotHeader);
+    const uint8_t* end = file_.data() + file_.size();
+
+    while (p + sizeof(SectionHeader) <= end) {
+        SectionHeader sh;
+        std::memcpy(&sh, p, sizeof(sh));
+        p += sizeof(sh);
+        if (sh.size > static_cast<uint64_t>(end - p)) return false;
+
+        if (sh.tag == tag) {
+            data = p;
+            size = sh.size;
+            return true;
+        }
+        p += padded(sh.size);
+    }
+    return false;
+}
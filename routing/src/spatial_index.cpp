@@ -0,0 +1,492 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+namespace {
+
+// Visit every grid cell at Chebyshev distance r from (cx, cy), clipped to the grid
+template <typename F>
+void for_each_ring_cell(int cx, int cy, int r, int nx, int ny, F&& visit) {
+    if (r == 0) {
+        visit(cx, cy);
+        return;
+    }
+
+    int x0 = std::max(cx - r, 0), x1 = std::min(cx + r, nx - 1);
+    if (cy - r >= 0) {
+        for (int x = x0; x <= x1; ++x) visit(x, cy - r);
+    }
+    if (cy + r < ny) {
+        for (int x = x0; x <= x1; ++x) visit(x, cy + r);
+    }
+
+    int y0 = std::max(cy - r + 1, 0), y1 = std::min(cy + r - 1, ny - 1);
+    if (cx - r >= 0) {
+        for (int y = y0; y <= y1; ++y) visit(cx - r, y);
+    }
+    if (cx + r < nx) {
+        for (int y = y0; y <= y1; ++y) visit(cx + r, y);
+    }
+}
+
+// Reorder entries into Sort-Tile-Recursive order: vertical slices by box
+// centre x, each slice sorted by centre y, so consecutive runs of
+// `capacity` entries form compact tiles.
+template <typename T, typename CX, typename CY>
+void str_order(std::vector<T>& entries, int capacity, CX center_x, CY center_y) {
+    size_t n = entries.size();
+    size_t pages = (n + capacity - 1) / capacity;
+    size_t slices = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(pages))));
+    size_t per_slice = std::max<size_t>(slices * capacity, 1);
+
+    std::sort(entries.begin(), entries.end(),
+              [&](const T& a, const T& b) { return center_x(a) < center_x(b); });
+    for (size_t begin = 0; begin < n; begin += per_slice) {
+        size_t end = std::min(begin + per_slice, n);
+        std::sort(entries.begin() + begin, entries.begin() + end,
+                  [&](const T& a, const T& b) { return center_y(a) < center_y(b); });
+    }
+}
+
+}
+
+NodeIndex::NodeIndex(const Graph& graph) {
+    int N = graph.num_nodes();
+    if (N == 0) return;
+
+    double lat_sum = 0.0, lon_sum = 0.0;
+    for (int i = 0; i < N; ++i) {
+        lat_sum += graph.get_node_lat(i);
+        lon_sum += graph.get_node_lon(i);
+    }
+    proj_ = LocalProjection(lat_sum / N, lon_sum / N);
+
+    std::vector<double> px(N), py(N);
+    double max_x = -std::numeric_limits<double>::infinity();
+    double max_y = -std::numeric_limits<double>::infinity();
+    min_x_ = std::numeric_limits<double>::infinity();
+    min_y_ = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < N; ++i) {
+        px[i] = proj_.x(graph.get_node_lon(i));
+        py[i] = proj_.y(graph.get_node_lat(i));
+        min_x_ = std::min(min_x_, px[i]);
+        min_y_ = std::min(min_y_, py[i]);
+        max_x = std::max(max_x, px[i]);
+        max_y = std::max(max_y, py[i]);
+    }
+
+    // Aim for roughly two nodes per cell
+    double area = std::max((max_x - min_x_) * (max_y - min_y_), 1.0);
+    cell_size_ = std::max(std::sqrt(area / std::max(N / 2, 1)), 1.0);
+    nx_ = static_cast<int>((max_x - min_x_) / cell_size_) + 1;
+    ny_ = static_cast<int>((max_y - min_y_) / cell_size_) + 1;
+
+    // Counting sort of nodes by cell
+    std::vector<int> cell_of(N);
+    cell_start_.assign(static_cast<size_t>(nx_) * ny_ + 1, 0);
+    for (int i = 0; i < N; ++i) {
+        px[i] -= min_x_;
+        py[i] -= min_y_;
+        cell_of[i] = cell_y(py[i]) * nx_ + cell_x(px[i]);
+        cell_start_[cell_of[i] + 1]++;
+    }
+    for (size_t c = 1; c < cell_start_.size(); ++c) {
+        cell_start_[c] += cell_start_[c - 1];
+    }
+
+    xs_.resize(N);
+    ys_.resize(N);
+    node_ids_.resize(N);
+    std::vector<int> cursor(cell_start_.begin(), cell_start_.end() - 1);
+    for (int i = 0; i < N; ++i) {
+        int at = cursor[cell_of[i]]++;
+        xs_[at] = static_cast<float>(px[i]);
+        ys_[at] = static_cast<float>(py[i]);
+        node_ids_[at] = i;
+    }
+}
+
+int NodeIndex::cell_x(double x) const {
+    return std::clamp(static_cast<int>(std::floor(x / cell_size_)), 0, nx_ - 1);
+}
+
+int NodeIndex::cell_y(double y) const {
+    return std::clamp(static_cast<int>(std::floor(y / cell_size_)), 0, ny_ - 1);
+}
+
+double NodeIndex::outside_bound(double x, double y, int x0, int x1, int y0, int y1) const {
+    double bound = std::numeric_limits<double>::infinity();
+    bool open = false;
+
+    if (x0 > 0)       { bound = std::min(bound, x - x0 * cell_size_);       open = true; }
+    if (x1 < nx_ - 1) { bound = std::min(bound, (x1 + 1) * cell_size_ - x); open = true; }
+    if (y0 > 0)       { bound = std::min(bound, y - y0 * cell_size_);       open = true; }
+    if (y1 < ny_ - 1) { bound = std::min(bound, (y1 + 1) * cell_size_ - y); open = true; }
+
+    return open ? std::max(bound, 0.0) : -1.0;
+}
+
+int NodeIndex::nearest(double lat, double lon) const {
+    if (empty()) return -1;
+
+    double qx = proj_.x(lon) - min_x_;
+    double qy = proj_.y(lat) - min_y_;
+    int cx = cell_x(qx), cy = cell_y(qy);
+
+    double best = std::numeric_limits<double>::infinity();
+    int best_id = -1;
+
+    for (int r = 0; ; ++r) {
+        for_each_ring_cell(cx, cy, r, nx_, ny_, [&](int x, int y) {
+            int c = y * nx_ + x;
+            for (int i = cell_start_[c]; i < cell_start_[c + 1]; ++i) {
+                double dx = xs_[i] - qx, dy = ys_[i] - qy;
+                double d = dx * dx + dy * dy;
+                if (d < best) {
+                    best = d;
+                    best_id = node_ids_[i];
+                }
+            }
+        });
+
+        double bound = outside_bound(qx, qy,
+                                     std::max(cx - r, 0), std::min(cx + r, nx_ - 1),
+                                     std::max(cy - r, 0), std::min(cy + r, ny_ - 1));
+        if (bound < 0) break;
+        if (best_id >= 0 && best <= bound * bound) break;
+    }
+    return best_id;
+}
+
+std::vector<int> NodeIndex::k_nearest(double lat, double lon, int k) const {
+    std::vector<int> result;
+    if (empty() || k <= 0) return result;
+
+    double qx = proj_.x(lon) - min_x_;
+    double qy = proj_.y(lat) - min_y_;
+    int cx = cell_x(qx), cy = cell_y(qy);
+
+    // max-heap of the k best (squared distance, node) seen so far
+    std::priority_queue<std::pair<double, int>> best;
+
+    for (int r = 0; ; ++r) {
+        for_each_ring_cell(cx, cy, r, nx_, ny_, [&](int x, int y) {
+            int c = y * nx_ + x;
+            for (int i = cell_start_[c]; i < cell_start_[c + 1]; ++i) {
+                double dx = xs_[i] - qx, dy = ys_[i] - qy;
+                double d = dx * dx + dy * dy;
+                if (static_cast<int>(best.size()) < k) {
+                    best.emplace(d, node_ids_[i]);
+                } else if (d < best.top().first) {
+                    best.pop();
+                    best.emplace(d, node_ids_[i]);
+                }
+            }
+        });
+
+        double bound = outside_bound(qx, qy,
+                                     std::max(cx - r, 0), std::min(cx + r, nx_ - 1),
+                                     std::max(cy - r, 0), std::min(cy + r, ny_ - 1));
+        if (bound < 0) break;
+        if (static_cast<int>(best.size()) == k && best.top().first <= bound * bound) break;
+    }
+
+    result.resize(best.size());
+    for (int i = static_cast<int>(best.size()) - 1; i >= 0; --i) {
+        result[i] = best.top().second;
+        best.pop();
+    }
+    return result;
+}
+
+EdgeIndex::EdgeIndex(const Graph& graph) {
+    int N = graph.num_nodes();
+    int E = graph.num_edges();
+    if (N == 0 || E == 0) return;
+
+    double lat_sum = 0.0, lon_sum = 0.0;
+    for (int i = 0; i < N; ++i) {
+        lat_sum += graph.get_node_lat(i);
+        lon_sum += graph.get_node_lon(i);
+    }
+    proj_ = LocalProjection(lat_sum / N, lon_sum / N);
+
+    struct Segment {
+        float ax, ay, bx, by;
+        int slot;
+    };
+
+    // One segment per straight piece of each edge's shape
+    std::vector<Segment> segments;
+    segments.reserve(E);
+    std::vector<std::pair<double, double>> shape;
+    for (int slot = 0; slot < E; ++slot) {
+        int a = graph.edge_source(slot), b = graph.edge_target(slot);
+        graph.edge_shape(slot, shape);
+        shape.insert(shape.begin(), {graph.get_node_lat(a), graph.get_node_lon(a)});
+        shape.emplace_back(graph.get_node_lat(b), graph.get_node_lon(b));
+
+        for (size_t i = 1; i < shape.size(); ++i) {
+            segments.push_back({
+                static_cast<float>(proj_.x(shape[i - 1].second)),
+                static_cast<float>(proj_.y(shape[i - 1].first)),
+                static_cast<float>(proj_.x(shape[i].second)),
+                static_cast<float>(proj_.y(shape[i].first)),
+                slot
+            });
+        }
+    }
+
+    str_order(segments, NODE_CAPACITY,
+              [](const Segment& s) { return s.ax + s.bx; },
+              [](const Segment& s) { return s.ay + s.by; });
+
+    int S = static_cast<int>(segments.size());
+    ax_.resize(S); ay_.resize(S); bx_.resize(S); by_.resize(S); slots_.resize(S);
+    for (int i = 0; i < S; ++i) {
+        ax_[i] = segments[i].ax;
+        ay_[i] = segments[i].ay;
+        bx_[i] = segments[i].bx;
+        by_[i] = segments[i].by;
+        slots_[i] = segments[i].slot;
+    }
+
+    // Leaves over consecutive runs of segments
+    std::vector<TreeNode> level;
+    for (int first = 0; first < S; first += NODE_CAPACITY) {
+        int count = std::min(NODE_CAPACITY, S - first);
+        Box box{std::min(ax_[first], bx_[first]), std::min(ay_[first], by_[first]),
+                std::max(ax_[first], bx_[first]), std::max(ay_[first], by_[first])};
+        for (int i = first + 1; i < first + count; ++i) {
+            box.min_x = std::min({box.min_x, ax_[i], bx_[i]});
+            box.min_y = std::min({box.min_y, ay_[i], by_[i]});
+            box.max_x = std::max({box.max_x, ax_[i], bx_[i]});
+            box.max_y = std::max({box.max_y, ay_[i], by_[i]});
+        }
+        level.push_back({box, first, count});
+    }
+
+    // Pack each level and build its parents until a single root remains
+    bool leaves = true;
+    while (true) {
+        if (level.size() > 1) {
+            str_order(level, NODE_CAPACITY,
+                      [](const TreeNode& n) { return n.box.min_x + n.box.max_x; },
+                      [](const TreeNode& n) { return n.box.min_y + n.box.max_y; });
+        }
+
+        int base = static_cast<int>(tree_.size());
+        tree_.insert(tree_.end(), level.begin(), level.end());
+        if (leaves) {
+            num_leaves_ = static_cast<int>(level.size());
+            leaves = false;
+        }
+        if (level.size() == 1) break;
+
+        std::vector<TreeNode> parents;
+        int n = static_cast<int>(level.size());
+        for (int first = 0; first < n; first += NODE_CAPACITY) {
+            int count = std::min(NODE_CAPACITY, n - first);
+            Box box = level[first].box;
+            for (int i = first + 1; i < first + count; ++i) {
+                box.min_x = std::min(box.min_x, level[i].box.min_x);
+                box.min_y = std::min(box.min_y, level[i].box.min_y);
+                box.max_x = std::max(box.max_x, level[i].box.max_x);
+                box.max_y = std::max(box.max_y, level[i].box.max_y);
+            }
+            parents.push_back({box, base + first, count});
+        }
+        level = std::move(parents);
+    }
+}
+
+namespace {
+
+double box_distance2(float min_x, float min_y, float max_x, float max_y, double x, double y) {
+    double dx = std::max({static_cast<double>(min_x) - x, 0.0, x - static_cast<double>(max_x)});
+    double dy = std::max({static_cast<double>(min_y) - y, 0.0, y - static_cast<double>(max_y)});
+    return dx * dx + dy * dy;
+}
+
+// Even-odd rule over the projected ring
+bool point_in_ring(const std::vector<double>& xs, const std::vector<double>& ys,
+                   double x, double y) {
+    bool inside = false;
+    size_t n = xs.size();
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        if ((ys[i] > y) != (ys[j] > y) &&
+            x < (xs[j] - xs[i]) * (y - ys[i]) / (ys[j] - ys[i]) + xs[i]) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+double cross(double ax, double ay, double bx, double by, double cx, double cy) {
+    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+// Proper or touching intersection of segments ab and cd
+bool segments_cross(double ax, double ay, double bx, double by,
+                    double cx, double cy, double dx, double dy) {
+    double d1 = cross(cx, cy, dx, dy, ax, ay);
+    double d2 = cross(cx, cy, dx, dy, bx, by);
+    double d3 = cross(ax, ay, bx, by, cx, cy);
+    double d4 = cross(ax, ay, bx, by, dx, dy);
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+        ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
+        return true;
+    }
+
+    auto on_segment = [](double px, double py, double qx, double qy, double rx, double ry) {
+        return std::min(px, qx) <= rx && rx <= std::max(px, qx) &&
+               std::min(py, qy) <= ry && ry <= std::max(py, qy);
+    };
+    return (d1 == 0 && on_segment(cx, cy, dx, dy, ax, ay)) ||
+           (d2 == 0 && on_segment(cx, cy, dx, dy, bx, by)) ||
+           (d3 == 0 && on_segment(ax, ay, bx, by, cx, cy)) ||
+           (d4 == 0 && on_segment(ax, ay, bx, by, dx, dy));
+}
+
+}
+
+double EdgeIndex::segment_distance2(int item, double x, double y) const {
+    double abx = bx_[item] - ax_[item], aby = by_[item] - ay_[item];
+    double apx = x - ax_[item], apy = y - ay_[item];
+
+    double ab2 = abx * abx + aby * aby;
+    double t = ab2 > 0.0 ? (apx * abx + apy * aby) / ab2 : 0.0;
+    t = std::clamp(t, 0.0, 1.0);
+
+    double dx = apx - t * abx, dy = apy - t * aby;
+    return dx * dx + dy * dy;
+}
+
+double EdgeIndex::nearest_distance(double lat, double lon) const {
+    if (empty()) return std::numeric_limits<double>::infinity();
+
+    double x = proj_.x(lon), y = proj_.y(lat);
+    double best = std::numeric_limits<double>::infinity();
+
+    using Entry = std::pair<double, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    int root = static_cast<int>(tree_.size()) - 1;
+    open.emplace(0.0, root);
+
+    while (!open.empty()) {
+        auto [d, idx] = open.top();
+        open.pop();
+        if (d >= best) break;
+
+        const TreeNode& node = tree_[idx];
+        if (idx < num_leaves_) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                best = std::min(best, segment_distance2(i, x, y));
+            }
+        } else {
+            for (int c = node.first; c < node.first + node.count; ++c) {
+                const Box& b = tree_[c].box;
+                double cd = box_distance2(b.min_x, b.min_y, b.max_x, b.max_y, x, y);
+                if (cd < best) open.emplace(cd, c);
+            }
+        }
+    }
+    return std::sqrt(best);
+}
+
+void EdgeIndex::within(double lat, double lon, double radius_m,
+                       std::vector<std::pair<int, double>>& out) const {
+    if (empty()) return;
+
+    double x = proj_.x(lon), y = proj_.y(lat);
+    double r2 = radius_m * radius_m;
+    size_t first_new = out.size();
+
+    std::vector<int> stack{static_cast<int>(tree_.size()) - 1};
+    while (!stack.empty()) {
+        int idx = stack.back();
+        stack.pop_back();
+
+        const TreeNode& node = tree_[idx];
+        const Box& b = node.box;
+        if (box_distance2(b.min_x, b.min_y, b.max_x, b.max_y, x, y) > r2) continue;
+
+        if (idx < num_leaves_) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                double d2 = segment_distance2(i, x, y);
+                if (d2 <= r2) out.emplace_back(slots_[i], std::sqrt(d2));
+            }
+        } else {
+            for (int c = node.first; c < node.first + node.count; ++c) {
+                stack.push_back(c);
+            }
+        }
+    }
+
+    // An edge with a shape has several segments; report each edge once, closest
+    std::sort(out.begin() + first_new, out.end());
+    auto last = std::unique(out.begin() + first_new, out.end(),
+                            [](const auto& a, const auto& b) { return a.first == b.first; });
+    out.erase(last, out.end());
+}
+
+void EdgeIndex::in_polygon(const std::vector<std::pair<double, double>>& polygon,
+                           std::vector<int>& out) const {
+    if (empty() || polygon.size() < 3) return;
+
+    size_t n = polygon.size();
+    std::vector<double> xs(n), ys(n);
+    double min_x = std::numeric_limits<double>::infinity(), max_x = -min_x;
+    double min_y = min_x, max_y = -min_x;
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = proj_.x(polygon[i].second);
+        ys[i] = proj_.y(polygon[i].first);
+        min_x = std::min(min_x, xs[i]);
+        max_x = std::max(max_x, xs[i]);
+        min_y = std::min(min_y, ys[i]);
+        max_y = std::max(max_y, ys[i]);
+    }
+
+    // A segment is in the polygon if an endpoint lies inside or it crosses
+    // the boundary
+    auto intersects = [&](int item) {
+        if (point_in_ring(xs, ys, ax_[item], ay_[item]) ||
+            point_in_ring(xs, ys, bx_[item], by_[item])) {
+            return true;
+        }
+        for (size_t i = 0, j = n - 1; i < n; j = i++) {
+            if (segments_cross(ax_[item], ay_[item], bx_[item], by_[item],
+                               xs[j], ys[j], xs[i], ys[i])) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    size_t first_new = out.size();
+    std::vector<int> stack{static_cast<int>(tree_.size()) - 1};
+    while (!stack.empty()) {
+        int idx = stack.back();
+        stack.pop_back();
+
+        const TreeNode& node = tree_[idx];
+        const Box& b = node.box;
+        if (b.max_x < min_x || b.min_x > max_x || b.max_y < min_y || b.min_y > max_y) continue;
+
+        if (idx < num_leaves_) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                if (intersects(i)) out.push_back(slots_[i]);
+            }
+        } else {
+            for (int c = node.first; c < node.first + node.count; ++c) {
+                stack.push_back(c);
+            }
+        }
+    }
+
+    std::sort(out.begin() + first_new, out.end());
+    out.erase(std::unique(out.begin() + first_new, out.end()), out.end());
+}
@@ -0,0 +1,192 @@
+#include "traffic.h"
+#include "router.h"
+#include "geo.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // Within this fraction of free flow a speed counts as recovered
+    constexpr double SETTLED = 0.01;
+}
+
+TrafficModel::TrafficModel(RoutingEngine& engine) : TrafficModel(engine, Options()) {}
+
+TrafficModel::TrafficModel(RoutingEngine& engine, const Options& options)
+    : engine_(engine), options_(options) {
+    const Graph& graph = engine.graph();
+    int E = graph.num_edges();
+
+    free_speed_.assign(E, 0.0f);
+    published_.resize(E);
+    tracked_.assign(E, 0);
+
+    std::vector<std::pair<double, double>> shape;
+    for (int slot = 0; slot < E; ++slot) {
+        double base = engine.baseline_weight(slot);
+        published_[slot] = static_cast<float>(base);
+
+        // Length along the road shape
+        double lat = graph.get_node_lat(graph.edge_source(slot));
+        double lon = graph.get_node_lon(graph.edge_source(slot));
+        double length = 0.0;
+        graph.edge_shape(slot, shape);
+        shape.emplace_back(graph.get_node_lat(graph.edge_target(slot)),
+                           graph.get_node_lon(graph.edge_target(slot)));
+        for (const auto& [next_lat, next_lon] : shape) {
+            length += haversine(lat, lon, next_lat, next_lon);
+            lat = next_lat;
+            lon = next_lon;
+        }
+
+        if (length > 0.0 && base > 0.0 && std::isfinite(base)) {
+            free_speed_[slot] = static_cast<float>(length / base);
+        }
+    }
+
+    speed_.assign(free_speed_.begin(), free_speed_.end());
+    updated_.assign(E, 0.0f);
+}
+
+TrafficModel::~TrafficModel() {
+    stop();
+}
+
+double TrafficModel::decayed(int slot, double t) const {
+    double dt = t - updated_[slot];
+    if (dt <= 0.0) return speed_[slot];
+
+    double free = free_speed_[slot];
+    return free + (speed_[slot] - free) * std::exp2(-dt / options_.half_life);
+}
+
+double TrafficModel::weight_at(int slot, double speed) const {
+    // Scaled from the baseline so free flow gives back exactly the original weight
+    return engine_.baseline_weight(slot) * (free_speed_[slot] / speed);
+}
+
+int TrafficModel::observe(const int* edge_ids, const double* speeds, const double* times,
+                          int count) {
+    const Graph& graph = engine_.graph();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int accepted = 0;
+    for (int i = 0; i < count; ++i) {
+        int slot = graph.slot_of_id(edge_ids[i]);
+        if (slot < 0 || free_speed_[slot] <= 0.0f) continue;
+        if (!(speeds[i] >= 0.0) || !std::isfinite(times[i])) continue;
+
+        if (!has_origin_) {
+            origin_ = times[i];
+            has_origin_ = true;
+        }
+        double t = times[i] - origin_;
+
+        double current = decayed(slot, t);
+        // A bad probe (a GPS jump) must not publish a near-free edge
+        double observed = std::min(std::max(speeds[i], options_.min_speed),
+                                   options_.max_speed_ratio * free_speed_[slot]);
+        speed_[slot] = static_cast<float>(current + options_.alpha * (observed - current));
+        updated_[slot] = static_cast<float>(std::max<double>(updated_[slot], t));
+
+        if (!tracked_[slot]) {
+            tracked_[slot] = 1;
+            active_.push_back(slot);
+        }
+        ++accepted;
+    }
+    return accepted;
+}
+
+int TrafficModel::flush(double now) {
+    // published_ must match what the engine holds, so a batch computed here
+    // is applied before any later one is computed
+    std::lock_guard<std::mutex> flushing(flush_mutex_);
+
+    std::vector<std::pair<int, double>> set;
+    std::vector<int> cleared;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_origin_) return 0;
+        double t = now - origin_;
+
+        size_t kept = 0;
+        for (int slot : active_) {
+            double speed = decayed(slot, t);
+            double free = free_speed_[slot];
+            bool settled = std::abs(speed - free) <= free * SETTLED;
+            if (settled) speed = free;
+
+            speed_[slot] = static_cast<float>(speed);
+            updated_[slot] = static_cast<float>(std::max<double>(updated_[slot], t));
+
+            if (settled) {
+                float base = static_cast<float>(engine_.baseline_weight(slot));
+                if (published_[slot] != base) {
+                    cleared.push_back(slot);
+                    published_[slot] = base;
+                }
+                tracked_[slot] = 0;
+                continue;
+            }
+
+            double weight = weight_at(slot, speed);
+            double last = published_[slot];
+            if (std::abs(weight - last) > options_.min_change * last) {
+                set.emplace_back(slot, weight);
+                published_[slot] = static_cast<float>(weight);
+            }
+            active_[kept++] = slot;
+        }
+        active_.resize(kept);
+    }
+
+    if (set.empty() && cleared.empty()) return 0;
+    engine_.apply_overrides(OverrideLayer::Traffic, set, cleared);
+    return static_cast<int>(set.size() + cleared.size());
+}
+
+void TrafficModel::start(double interval) {
+    if (running_) return;
+    running_ = true;
+
+    flusher_ = std::thread([this, interval] {
+        auto period = std::chrono::duration<double>(interval);
+        std::unique_lock<std::mutex> lock(flusher_mutex_);
+        while (running_) {
+            flusher_cv_.wait_for(lock, period, [this] { return !running_; });
+            if (!running_) break;
+            flush(now());
+        }
+    });
+}
+
+void TrafficModel::stop() {
+    if (!running_) return;
+    {
+        std::lock_guard<std::mutex> lock(flusher_mutex_);
+        running_ = false;
+    }
+    flusher_cv_.notify_all();
+    if (flusher_.joinable()) flusher_.join();
+}
+
+double TrafficModel::speed(int edge_id, double now) const {
+    int slot = engine_.graph().slot_of_id(edge_id);
+    if (slot < 0) return -1.0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_origin_) return speed_[slot];
+    return decayed(slot, now - origin_);
+}
+
+double TrafficModel::free_flow_speed(int edge_id) const {
+    int slot = engine_.graph().slot_of_id(edge_id);
+    return slot < 0 ? -1.0 : free_speed_[slot];
+}
+
+double TrafficModel::now() {
+    using namespace std::chrono;
+    return duration<double>(system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,53 @@
+#include "update_queue.h"
+
+#include <cstdint>
+
+UpdateQueue::UpdateQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    cells_.reset(new Cell[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool UpdateQueue::push(int slot, double weight) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+        if (diff == 0) {
+            // Free for this position; claim it
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            // Still holds the item from one lap ago
+            return false;
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->slot = slot;
+    cell->weight = weight;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+size_t UpdateQueue::drain(std::vector<std::pair<int, double>>& out) {
+    size_t count = 0;
+    while (true) {
+        Cell& cell = cells_[head_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != head_ + 1) break;
+
+        out.emplace_back(cell.slot, cell.weight);
+        cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        ++count;
+    }
+    return count;
+}